@@ -0,0 +1,289 @@
+/**
+ * In-process cluster benchmark: N nodes connected by an in-memory network (no sockets, no root).
+ * Every node proposes its shots one after the other, each as soon as the previous one is decided.
+ * Reports decisions/sec and the propose -> decide latency as JSON.
+ *
+ * Usage: cluster_bench [--nodes N] [--shots S] [--vs VS] [--ds DS] [--loss P] 
+ *                      [--delay-us D] [--jitter-us J] [--timeout-s T] [--seed SEED]
+ *                      [--tuning FILE] [--tune NAME=VALUE]... [--sweep NAME=V1,V2,...]... [--sweep-output FILE]
+ *
+ * --sweep runs the cluster once per combination of the swept tunables (cartesian product, on top of --tuning and
+ * --tune) under the same network profile, prints one JSON line per run, then the tunables of the run with the most
+ * decisions/sec among those that completed. --sweep-output also writes them as a tuning file for da_proc --tuning.
+ */
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "node.hpp"
+#include "metrics.hpp"
+#include "transport.hpp"
+
+namespace {
+
+struct Options {
+  size_t nodes = 3;
+  size_t shots = 1000;
+  uint32_t vs = 3;
+  uint32_t ds = 10;
+  NetworkConditions network;
+  std::chrono::seconds timeout{60};
+  Tunables tunables;
+  std::vector<std::pair<std::string, std::vector<std::string>>> sweep;  // tunable, values
+  std::string sweep_output;
+};
+
+// Parses NAME=V1,V2,...
+std::pair<std::string, std::vector<std::string>> parseSweep(const std::string &value)
+{
+  size_t equal = value.find('=');
+  if (equal == std::string::npos || equal + 1 == value.size()) {
+    throw std::invalid_argument("Expected --sweep NAME=V1,V2,..., got " + value);
+  }
+  std::pair<std::string, std::vector<std::string>> sweep{value.substr(0, equal), {}};
+  std::stringstream values(value.substr(equal + 1));
+  std::string v;
+  while (std::getline(values, v, ',')) {
+    Tunables().set(sweep.first, v); // validates the name and value
+    sweep.second.push_back(v);
+  }
+  return sweep;
+}
+
+Options parseOptions(int argc, char **argv)
+{
+  Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    std::string value = argv[i + 1];
+    if (arg == "--nodes") options.nodes = std::stoul(value);
+    else if (arg == "--shots") options.shots = std::stoul(value);
+    else if (arg == "--vs") options.vs = static_cast<uint32_t>(std::stoul(value));
+    else if (arg == "--ds") options.ds = static_cast<uint32_t>(std::stoul(value));
+    else if (arg == "--loss") options.network.loss = std::stod(value);
+    else if (arg == "--delay-us") options.network.delay = std::chrono::microseconds(std::stol(value));
+    else if (arg == "--jitter-us") options.network.jitter = std::chrono::microseconds(std::stol(value));
+    else if (arg == "--timeout-s") options.timeout = std::chrono::seconds(std::stol(value));
+    else if (arg == "--seed") options.network.seed = static_cast<uint32_t>(std::stoul(value));
+    else if (arg == "--tuning") options.tunables.load(value);
+    else if (arg == "--tune") options.tunables.assign(value);
+    else if (arg == "--sweep") options.sweep.push_back(parseSweep(value));
+    else if (arg == "--sweep-output") options.sweep_output = value;
+    else throw std::invalid_argument("Unknown option " + arg);
+  }
+  if (options.nodes < 2) throw std::invalid_argument("At least two nodes are required");
+  if (options.vs > options.ds) throw std::invalid_argument("vs must not exceed ds");
+  return options;
+}
+
+// Shared progress of all nodes
+struct Progress {
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t decided = 0;
+  Histogram latency_us;
+};
+
+/**
+ * Proposes the shots of one node sequentially, from the decision callback of the previous shot
+ */
+class Driver {
+public:
+  Driver(Node &node, std::vector<std::set<proposal_t>> proposals, Progress &progress)
+    : node(node), proposals(std::move(proposals)), progress(progress) {}
+
+  void proposeNext()
+  {
+    if (next == proposals.size()) return;
+    proposed_at = std::chrono::steady_clock::now();
+    node.propose(std::move(proposals[next++]), [this](prop_nb_t, const std::set<proposal_t>&) {
+      progress.latency_us.record(microsecondsSince(proposed_at));
+      {
+        std::lock_guard<std::mutex> lock(progress.mutex);
+        progress.decided++;
+      }
+      progress.cv.notify_one();
+      proposeNext();
+    });
+  }
+
+private:
+  Node &node;
+  std::vector<std::set<proposal_t>> proposals;
+  Progress &progress;
+  size_t next = 0;
+  std::chrono::steady_clock::time_point proposed_at;
+};
+
+std::vector<std::set<proposal_t>> randomProposals(const Options &options, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<proposal_t> dist(1, options.ds);
+  std::vector<std::set<proposal_t>> proposals(options.shots);
+  for (auto &proposal: proposals) {
+    while (proposal.size() < options.vs) proposal.insert(dist(rng));
+  }
+  return proposals;
+}
+
+struct Result {
+  size_t decided = 0;
+  bool completed = false;
+  double elapsed_s = 0;
+  uint64_t p50_us = 0, p99_us = 0, p999_us = 0, max_us = 0;
+
+  double decisionsPerSec() const { return elapsed_s > 0 ? static_cast<double>(decided) / elapsed_s : 0.0; }
+};
+
+Result runCluster(const Options &options, const Tunables &tunables)
+{
+  // Hosts only provide the addresses the in-memory network routes on
+  std::vector<Parser::Host> hosts;
+  std::string ip = "127.0.0.1";
+  for (size_t i = 1; i <= options.nodes; i++) {
+    hosts.emplace_back(i, ip, static_cast<unsigned short>(11000 + i));
+  }
+
+  auto network = std::make_shared<InMemoryNetwork>(options.network);
+  std::vector<std::unique_ptr<Node>> nodes;
+  for (size_t i = 1; i <= options.nodes; i++) {
+    auto transport = network->attach(setupIpAddress(hosts[i - 1]));
+    nodes.push_back(std::make_unique<Node>(hosts, i, "/dev/null", options.ds, std::move(transport), tunables));
+  }
+
+  Progress progress;
+  std::vector<std::unique_ptr<Driver>> drivers;
+  for (size_t i = 0; i < options.nodes; i++) {
+    drivers.push_back(std::make_unique<Driver>(*nodes[i], randomProposals(options, options.network.seed + static_cast<uint32_t>(i)), progress));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (auto &node: nodes) node->start();
+  for (auto &driver: drivers) driver->proposeNext();
+
+  // Wait for every node to decide all its shots (or the timeout)
+  size_t expected = options.nodes * options.shots;
+  Result result;
+  {
+    std::unique_lock<std::mutex> lock(progress.mutex);
+    progress.cv.wait_for(lock, options.timeout, [&]() { return progress.decided == expected; });
+    result.decided = progress.decided;
+  }
+  result.elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for (auto &node: nodes) node->terminate();
+
+  result.completed = result.decided == expected;
+  result.p50_us = progress.latency_us.percentile(0.5);
+  result.p99_us = progress.latency_us.percentile(0.99);
+  result.p999_us = progress.latency_us.percentile(0.999);
+  result.max_us = progress.latency_us.max();
+  return result;
+}
+
+void printTunables(std::ostream &os, const Tunables &tunables)
+{
+  os << "{";
+  bool first = true;
+  for (const std::string &name: Tunables::names()) {
+    os << (first ? "" : ", ") << "\"" << name << "\": " << tunables.get(name);
+    first = false;
+  }
+  os << "}";
+}
+
+void printResult(const Options &options, const Tunables &tunables, const Result &result)
+{
+  std::cout << "{\"nodes\": " << options.nodes
+            << ", \"shots\": " << options.shots
+            << ", \"loss\": " << options.network.loss
+            << ", \"delay_us\": " << options.network.delay.count()
+            << ", \"jitter_us\": " << options.network.jitter.count()
+            << ", \"tunables\": ";
+  printTunables(std::cout, tunables);
+  std::cout << ", \"decisions\": " << result.decided
+            << ", \"completed\": " << (result.completed ? "true" : "false")
+            << ", \"elapsed_s\": " << result.elapsed_s
+            << ", \"decisions_per_sec\": " << result.decisionsPerSec()
+            << ", \"latency_us\": {\"p50\": " << result.p50_us
+            << ", \"p99\": " << result.p99_us
+            << ", \"p999\": " << result.p999_us
+            << ", \"max\": " << result.max_us << "}}" << std::endl;
+}
+
+// Tunables of every combination of the swept values, the first sweep varying slowest
+std::vector<Tunables> sweepCombinations(const Options &options)
+{
+  std::vector<Tunables> combinations{options.tunables};
+  for (const auto &[name, values]: options.sweep) {
+    std::vector<Tunables> next;
+    for (const Tunables &base: combinations) {
+      for (const std::string &value: values) {
+        next.push_back(base);
+        next.back().set(name, value);
+      }
+    }
+    combinations = std::move(next);
+  }
+  return combinations;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  try {
+    options = parseOptions(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+
+  if (options.sweep.empty()) {
+    Result result = runCluster(options, options.tunables);
+    printResult(options, options.tunables, result);
+    return result.completed ? 0 : 1;
+  }
+
+  bool found = false;
+  Tunables best;
+  Result best_result;
+  for (const Tunables &tunables: sweepCombinations(options)) {
+    Result result = runCluster(options, tunables);
+    printResult(options, tunables, result);
+    if (result.completed && (!found || result.decisionsPerSec() > best_result.decisionsPerSec())) {
+      found = true;
+      best = tunables;
+      best_result = result;
+    }
+  }
+  if (!found) {
+    std::cerr << "No combination completed within the timeout\n";
+    return 1;
+  }
+
+  std::cout << "{\"best\": ";
+  printTunables(std::cout, best);
+  std::cout << ", \"decisions_per_sec\": " << best_result.decisionsPerSec() << "}" << std::endl;
+  if (!options.sweep_output.empty()) {
+    std::ofstream out(options.sweep_output);
+    out << "# cluster_bench sweep: " << options.nodes << " nodes, loss " << options.network.loss
+        << ", delay " << options.network.delay.count() << " us, jitter " << options.network.jitter.count() << " us\n";
+    best.write(out);
+    if (!out) {
+      std::cerr << "Failed to write " << options.sweep_output << "\n";
+      return 1;
+    }
+  }
+  return 0;
+}
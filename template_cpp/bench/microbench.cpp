@@ -0,0 +1,375 @@
+/**
+ * Microbenchmarks for the hot data paths (serialization, link containers, lattice agreement sets, UDP loopback).
+ * Each benchmark runs over a range of sizes and reports ns/op, bytes/op and allocations/op as JSON.
+ *
+ * Usage: microbench [output.json] [--min-time-ms N] [--filter substring]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "globals.hpp"
+#include "message.hpp"
+#include "sets.hpp"
+#include "maps.hpp"
+#include "deque.hpp"
+#include "transport.hpp"
+#include "uring.hpp"
+
+// ===================== Allocation counting start ===================== //
+static std::atomic<uint64_t> alloc_count{0};
+static std::atomic<uint64_t> alloc_bytes{0};
+
+void* operator new(std::size_t size)
+{
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+// ===================== Allocation counting end ===================== //
+
+namespace {
+
+struct Result {
+  std::string name;
+  size_t size;
+  uint64_t iterations;
+  double ns_per_op;
+  double bytes_per_op;        // payload bytes processed per operation
+  double allocs_per_op;
+  double alloc_bytes_per_op;
+};
+
+struct Options {
+  std::string output;
+  std::chrono::milliseconds min_time{200};
+  std::string filter;
+};
+
+// Keeps the optimizer from discarding a result
+template <typename T>
+void doNotOptimize(const T &value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class Bench {
+public:
+  explicit Bench(const Options &options) : options(options) {}
+
+  /**
+   * Times op (one call = `ops` operations) until min_time has elapsed, after a warm-up call.
+   * The best of three repetitions is reported, which keeps runs on a busy host comparable.
+   */
+  void run(const std::string &name, size_t size, double bytes_per_op, uint64_t ops, const std::function<void()> &op)
+  {
+    if (!options.filter.empty() && name.find(options.filter) == std::string::npos) return;
+    op();
+
+    Result best{name, size, 0, 0, bytes_per_op, 0, 0};
+    for (int rep = 0; rep < 3; rep++) {
+      uint64_t calls = 0;
+      uint64_t allocs_before = alloc_count.load();
+      uint64_t bytes_before = alloc_bytes.load();
+      auto start = std::chrono::steady_clock::now();
+      auto elapsed = std::chrono::steady_clock::duration::zero();
+      while (elapsed < options.min_time) {
+        op();
+        calls++;
+        elapsed = std::chrono::steady_clock::now() - start;
+      }
+
+      double total_ops = static_cast<double>(calls * ops);
+      double ns_per_op = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / total_ops;
+      if (rep == 0 || ns_per_op < best.ns_per_op) {
+        best.iterations = calls * ops;
+        best.ns_per_op = ns_per_op;
+        best.allocs_per_op = static_cast<double>(alloc_count.load() - allocs_before) / total_ops;
+        best.alloc_bytes_per_op = static_cast<double>(alloc_bytes.load() - bytes_before) / total_ops;
+      }
+    }
+
+    std::cerr << name << "/" << size << ": " << best.ns_per_op << " ns/op, " 
+              << best.allocs_per_op << " allocs/op\n";
+    results.push_back(best);
+  }
+
+  void writeJson(std::ostream &os) const
+  {
+    os << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result &r = results[i];
+      os << "    {\"name\": \"" << r.name << "\", \"size\": " << r.size
+         << ", \"iterations\": " << r.iterations
+         << ", \"ns_per_op\": " << r.ns_per_op
+         << ", \"bytes_per_op\": " << r.bytes_per_op
+         << ", \"allocs_per_op\": " << r.allocs_per_op
+         << ", \"alloc_bytes_per_op\": " << r.alloc_bytes_per_op << "}"
+         << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+  }
+
+private:
+  Options options;
+  std::vector<Result> results;
+};
+
+// Proposal set sizes, up to the protocol maximum
+const std::vector<size_t> set_sizes = {1, 8, 64, 512, MAX_PROPOSAL_SET_SIZE};
+
+// Sorted, duplicate free values drawn from [1, 4 * count] (fixed seed: runs are repeatable)
+std::vector<proposal_t> randomSortedValues(size_t count, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<proposal_t> dist(1, static_cast<proposal_t>(4 * count));
+  std::set<proposal_t> values;
+  while (values.size() < count) values.insert(dist(rng));
+  return std::vector<proposal_t>(values.begin(), values.end());
+}
+
+std::shared_ptr<const Message> makeMessage(size_t set_size, uint32_t seed)
+{
+  return std::make_shared<Message>(MES, 1, 0, randomSortedValues(set_size, seed));
+}
+
+void benchMessages(Bench &bench)
+{
+  for (size_t n: set_sizes) {
+    auto msg = makeMessage(n, 1);
+    double bytes = static_cast<double>(msg->serializedSize());
+    std::vector<char> buffer(Message::max_serialized_size);
+
+    // Hot path: the wire image is cached after the first encoding
+    bench.run("message_serialize", n, bytes, 1, [&]() {
+      size_t offset = 0;
+      msg->serializeTo(buffer.data(), offset);
+      doNotOptimize(buffer.data());
+    });
+
+    // First encoding of a freshly built message (includes copying the values)
+    bench.run("message_serialize_uncached", n, bytes, 1, [&]() {
+      Message fresh(MES, 1, 0, msg->proposed_values);
+      size_t offset = 0;
+      fresh.serializeTo(buffer.data(), offset);
+      doNotOptimize(buffer.data());
+    });
+
+    bench.run("message_deserialize", n, bytes, 1, [&]() {
+      size_t offset = 0;
+      Message decoded = Message::deserialize(buffer.data(), buffer.size(), offset);
+      doNotOptimize(decoded.proposed_values.data());
+    });
+  }
+}
+
+void benchPackets(Bench &bench)
+{
+  for (size_t n: set_sizes) {
+    std::array<pkt_seq_t, MAX_MESSAGES_PER_PACKET> seqs;
+    std::array<std::shared_ptr<const Message>, MAX_MESSAGES_PER_PACKET> msgs;
+    for (size_t i = 0; i < MAX_MESSAGES_PER_PACKET; i++) {
+      seqs[i] = static_cast<pkt_seq_t>(i + 1);
+      msgs[i] = makeMessage(n, static_cast<uint32_t>(i + 1));
+    }
+    Packet packet(MES, MAX_MESSAGES_PER_PACKET, seqs, msgs);
+    std::vector<char> buffer(packet.serializedSize());
+    double bytes = static_cast<double>(packet.serialize(buffer.data()));
+
+    bench.run("packet_serialize", n, bytes, 1, [&]() {
+      doNotOptimize(packet.serialize(buffer.data()));
+    });
+
+    bench.run("packet_deserialize", n, bytes, 1, [&]() {
+      Packet decoded = Packet::deserialize(buffer.data(), buffer.size());
+      doNotOptimize(decoded.getNbMes());
+    });
+  }
+}
+
+void benchSlidingSet(Bench &bench)
+{
+  // Size: reordering window of the received sequence numbers (1 = in order)
+  constexpr size_t packets = 1024;
+  for (size_t window: {size_t{1}, size_t{64}, size_t{256}}) {
+    std::vector<pkt_seq_t> order(packets * MAX_MESSAGES_PER_PACKET);
+    std::iota(order.begin(), order.end(), 1);
+    std::mt19937 rng(7);
+    for (size_t i = 0; i < order.size(); i += window) {
+      std::shuffle(order.begin() + static_cast<std::ptrdiff_t>(i),
+                   order.begin() + static_cast<std::ptrdiff_t>(std::min(i + window, order.size())), rng);
+    }
+
+    bench.run("sliding_set_insert", window, sizeof(pkt_seq_t) * MAX_MESSAGES_PER_PACKET, packets, [&]() {
+      SlidingSet<pkt_seq_t> delivered;
+      for (size_t p = 0; p < packets; p++) {
+        std::array<pkt_seq_t, MAX_MESSAGES_PER_PACKET> seqs;
+        std::copy_n(order.begin() + static_cast<std::ptrdiff_t>(p * MAX_MESSAGES_PER_PACKET), MAX_MESSAGES_PER_PACKET, seqs.begin());
+        doNotOptimize(delivered.insert(seqs, MAX_MESSAGES_PER_PACKET));
+      }
+    });
+  }
+}
+
+void benchConcurrentMap(Bench &bench)
+{
+  // Size: pending (unacknowledged) messages on the link, snapshot taken by every send round
+  auto msg = std::const_pointer_cast<Message>(makeMessage(8, 1));
+  for (size_t pending: {size_t{8}, size_t{64}, size_t{MAX_CONTAINER_SIZE}}) {
+    ConcurrentDeque<std::pair<pkt_seq_t, std::shared_ptr<Message>>> queue;
+    ConcurrentMap<pkt_seq_t, std::shared_ptr<Message>> map(true);
+    for (size_t i = 0; i < pending; i++) queue.push_back(std::make_pair(static_cast<pkt_seq_t>(i + 1), msg));
+    std::vector<std::pair<pkt_seq_t, std::shared_ptr<Message>>> snapshot;
+    map.complete(queue, MAX_CONTAINER_SIZE, snapshot);
+
+    bench.run("concurrent_map_complete", pending, 0, 1, [&]() {
+      doNotOptimize(map.complete(queue, MAX_CONTAINER_SIZE, snapshot));
+    });
+  }
+}
+
+void benchConcurrentDeque(Bench &bench)
+{
+  // Size: producer threads pushing against one consumer popping batches
+  constexpr size_t items_per_producer = 20000;
+  for (size_t producers: {size_t{1}, size_t{2}, size_t{4}}) {
+    auto msg = std::const_pointer_cast<Message>(makeMessage(8, 1));
+    bench.run("concurrent_deque_push_pop", producers, 0, producers * items_per_producer, [&]() {
+      ConcurrentDeque<std::pair<pkt_seq_t, std::shared_ptr<Message>>> queue;
+      std::vector<std::thread> threads;
+      for (size_t t = 0; t < producers; t++) {
+        threads.emplace_back([&queue, &msg]() {
+          for (size_t i = 0; i < items_per_producer; i++) queue.push_back(std::make_pair(static_cast<pkt_seq_t>(i), msg));
+        });
+      }
+      size_t popped = 0;
+      while (popped < producers * items_per_producer) {
+        popped += queue.wait_pop_k_front(MAX_CONTAINER_SIZE, std::chrono::milliseconds(1)).size();
+      }
+      for (auto &thread: threads) thread.join();
+    });
+  }
+}
+
+void benchLatticeSets(Bench &bench)
+{
+  // Acceptor step: accept if the proposal contains the accepted set, otherwise merge (see LatticeAgreementInstance::processMessage)
+  for (size_t n: set_sizes) {
+    std::vector<proposal_t> accepted = randomSortedValues(n, 1);
+    std::vector<proposal_t> proposed = randomSortedValues(n, 2);
+
+    bench.run("la_includes_merge", n, static_cast<double>(2 * n * sizeof(proposal_t)), 1, [&]() {
+      bool acknowledge = std::includes(proposed.begin(), proposed.end(), accepted.begin(), accepted.end());
+      std::vector<proposal_t> merged;
+      merged.reserve(accepted.size() + proposed.size());
+      std::set_union(accepted.begin(), accepted.end(), proposed.begin(), proposed.end(), std::back_inserter(merged));
+      doNotOptimize(acknowledge);
+      doNotOptimize(merged.data());
+    });
+  }
+}
+
+void benchUdpLoopback(Bench &bench)
+{
+  // Size: datagrams per send call (all to the same peer, as a link's round), with and without offload, then over io_uring
+  constexpr size_t datagram_size = 256;
+  uint16_t port = static_cast<uint16_t>(40000 + getpid() % 20000);
+  for (std::string variant: {"plain", "offload", "uring"}) {
+    UdpConfig config;
+    config.offload = variant != "plain";
+    sockaddr_in sender_addr{}, receiver_addr{};
+    sender_addr.sin_family = receiver_addr.sin_family = AF_INET;
+    sender_addr.sin_addr.s_addr = receiver_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sender_addr.sin_port = htons(port++);
+    receiver_addr.sin_port = htons(port++);
+    std::unique_ptr<UdpTransport> sender, receiver;
+    try {
+      if (variant == "uring") {
+        sender = std::make_unique<UringTransport>(sender_addr, config);
+        receiver = std::make_unique<UringTransport>(receiver_addr, config);
+      }
+      else {
+        sender = std::make_unique<UdpTransport>(sender_addr, config);
+        receiver = std::make_unique<UdpTransport>(receiver_addr, config);
+      }
+    } catch (const std::runtime_error& e) {
+      std::cerr << "udp_loopback_" << variant << " skipped: " << e.what() << "\n";
+      continue;
+    }
+
+    std::vector<char> payload(datagram_size, 'x');
+    std::vector<char> buffer(Packet::max_serialized_size);
+    for (size_t n: {size_t{1}, size_t{8}, size_t{64}}) {
+      std::vector<Datagram> datagrams(n, Datagram{payload.data(), payload.size(), receiver_addr});
+      bench.run("udp_loopback_" + variant, n, datagram_size, n, [&]() {
+        sender->send(datagrams.data(), datagrams.size());
+        // Drain what arrived (a datagram dropped on a full queue ends the wait after 100ms)
+        size_t received = 0;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+        while (received < n && std::chrono::steady_clock::now() < deadline) {
+          sockaddr_in from;
+          if (receiver->tryReceive(buffer.data(), buffer.size(), from) > 0) received++;
+        }
+      });
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--min-time-ms" && i + 1 < argc) {
+      options.min_time = std::chrono::milliseconds(std::stoul(argv[++i]));
+    } else if (arg == "--filter" && i + 1 < argc) {
+      options.filter = argv[++i];
+    } else {
+      options.output = arg;
+    }
+  }
+
+  Bench bench(options);
+  benchMessages(bench);
+  benchPackets(bench);
+  benchSlidingSet(bench);
+  benchConcurrentMap(bench);
+  benchConcurrentDeque(bench);
+  benchLatticeSets(bench);
+  benchUdpLoopback(bench);
+
+  if (options.output.empty()) {
+    bench.writeJson(std::cout);
+  } else {
+    std::ofstream file(options.output);
+    bench.writeJson(file);
+    std::cerr << "Results written to " << options.output << "\n";
+  }
+  return 0;
+}
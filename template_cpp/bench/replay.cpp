@@ -0,0 +1,161 @@
+/**
+ * Offline replay of a trace recorded with `da_proc ... --trace PATH`: feeds the datagrams received by the traced
+ * process back through its perfect links and lattice agreement (Packet::deserialize, PerfectLink::receive, then
+ * LatticeAgreementInstance::processMessage) on a single thread and as fast as possible, with its proposals
+ * replayed in between. Datagrams sent by the node are discarded, so the run times the processing pipeline alone
+ * and builds can be compared on identical input.
+ *
+ * Usage: replay TRACE [--repeat N]
+ * Prints one JSON line (best of the N runs, each on a fresh node).
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "helper.hpp"
+#include "node.hpp"
+#include "trace.hpp"
+#include "transport.hpp"
+
+namespace {
+
+struct Options {
+  std::string trace;
+  size_t repeat = 3;
+};
+
+Options parseOptions(int argc, char **argv)
+{
+  if (argc < 2) throw std::invalid_argument("Usage: replay TRACE [--repeat N]");
+  Options options;
+  options.trace = argv[1];
+  for (int i = 2; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    std::string value = argv[i + 1];
+    if (arg == "--repeat") options.repeat = std::max<size_t>(1, std::stoul(value));
+    else throw std::invalid_argument("Unknown option " + arg);
+  }
+  return options;
+}
+
+/**
+ * Transport of the replayed node: what it sends (ACKs, proposals, responses) is dropped
+ */
+class DiscardTransport : public Transport {
+public:
+  void send(const Datagram *, size_t count) override { sent += count; }
+  ssize_t receive(size_t, char *, size_t, sockaddr_in &) override { return 0; } // the replay delivers datagrams itself
+  void shutdown() override {}
+  void close() override {}
+
+  uint64_t sent = 0;
+};
+
+// Trace record, with the sender address resolved beforehand
+struct Event {
+  TraceKind kind;
+  sockaddr_in from;
+  std::vector<char> data;
+};
+
+struct Run {
+  double wall_s = 0;
+  uint64_t decisions = 0;
+  uint64_t sent = 0;
+};
+
+Run replay(const TraceReader &trace, const std::vector<Event> &events)
+{
+  auto transport = std::make_unique<DiscardTransport>();
+  DiscardTransport &discard = *transport;
+  Node node(trace.hosts(), trace.id(), "/dev/null", trace.ds(), std::move(transport));
+
+  Run run;
+  auto start = std::chrono::steady_clock::now();
+  for (const Event &event: events) {
+    if (event.kind == TraceKind::RECEIVED) {
+      node.receiveDatagram(event.data.data(), event.data.size(), event.from);
+    }
+    else {
+      std::set<proposal_t> proposal;
+      for (size_t offset = 0; offset + sizeof(proposal_t) <= event.data.size(); offset += sizeof(proposal_t)) {
+        proposal_t value;
+        std::memcpy(&value, event.data.data() + offset, sizeof(value));
+        proposal.insert(value);
+      }
+      node.propose(std::move(proposal), [&run](prop_nb_t, const std::set<proposal_t>&) noexcept { run.decisions++; });
+    }
+    node.stepProposals();
+  }
+  run.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  run.sent = discard.sent;
+  return run;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  try {
+    options = parseOptions(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+
+  // The whole trace is loaded first, so that reading it is not timed
+  std::optional<TraceReader> trace;
+  std::vector<Event> events;
+  uint64_t received = 0, sent = 0, proposals = 0, unknown = 0;
+  try {
+    trace.emplace(options.trace);
+    TraceRecord record;
+    std::vector<char> data;
+    while (trace->next(record, data)) {
+      if (record.kind == TraceKind::SENT) {
+        sent++;
+        continue;
+      }
+      Event event{record.kind, {}, data};
+      if (record.kind == TraceKind::RECEIVED) {
+        auto host = std::find_if(trace->hosts().begin(), trace->hosts().end(), [&](const Parser::Host &h) { return h.id == record.peer; });
+        if (host == trace->hosts().end()) {
+          unknown++;
+          continue;
+        }
+        event.from = setupIpAddress(*host);
+        received++;
+      }
+      else {
+        proposals++;
+      }
+      events.push_back(std::move(event));
+    }
+  } catch (const std::runtime_error &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+
+  Run best;
+  for (size_t i = 0; i < options.repeat; i++) {
+    Run run = replay(*trace, events);
+    if (i == 0 || run.wall_s < best.wall_s) best = run;
+  }
+
+  std::cout << "{\"trace\": \"" << options.trace << "\", \"id\": " << trace->id()
+            << ", \"received\": " << received << ", \"sent_recorded\": " << sent << ", \"proposals\": " << proposals
+            << ", \"unknown_senders\": " << unknown
+            << ", \"decisions\": " << best.decisions << ", \"sent_replayed\": " << best.sent
+            << ", \"wall_s\": " << best.wall_s
+            << ", \"ns_per_datagram\": " << (received > 0 ? best.wall_s * 1e9 / static_cast<double>(received) : 0.0)
+            << "}" << std::endl;
+  return 0;
+}
@@ -0,0 +1,276 @@
+/**
+ * Discrete-event simulator: runs N nodes (perfect links and lattice agreement of the real engine) 
+ * on a single thread and a virtual clock, over a modelled network. The nodes read the virtual clock for their
+ * send pacing, peer suspicion and latency histograms.
+ * - latency: base + exponentially distributed tail
+ * - loss: independent per datagram
+ * - bandwidth: per directed link, datagrams are serialized one after the other
+ * Runs are deterministic for a given seed. Sweeps the cartesian product of the node counts, vs and ds values
+ * and prints one JSON line per configuration, with the propose -> decide latency of the instances over all nodes.
+ *
+ * Usage: simulator [--nodes 3,10,50] [--vs 3] [--ds 10] [--shots S] [--latency-us L] [--latency-tail-us T]
+ *                  [--loss P] [--bandwidth-mbps B] [--send-interval-us I] [--max-virtual-s M] [--seed SEED]
+ */
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "node.hpp"
+#include "metrics.hpp"
+#include "transport.hpp"
+
+namespace {
+
+struct Options {
+  std::vector<size_t> nodes{3, 10, 50};
+  std::vector<uint32_t> vs{3};
+  std::vector<uint32_t> ds{10};
+  size_t shots = 10;
+  double latency_us = 100;
+  double latency_tail_us = 50;
+  double loss = 0.0;
+  double bandwidth_mbps = 1000;
+  int64_t send_interval_us = 1000;
+  double max_virtual_s = 600;
+  uint32_t seed = 1;
+};
+
+template <typename T>
+std::vector<T> parseList(const std::string &value)
+{
+  std::vector<T> values;
+  std::istringstream is(value);
+  std::string item;
+  while (std::getline(is, item, ',')) values.push_back(static_cast<T>(std::stoul(item)));
+  return values;
+}
+
+Options parseOptions(int argc, char **argv)
+{
+  Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    std::string value = argv[i + 1];
+    if (arg == "--nodes") options.nodes = parseList<size_t>(value);
+    else if (arg == "--vs") options.vs = parseList<uint32_t>(value);
+    else if (arg == "--ds") options.ds = parseList<uint32_t>(value);
+    else if (arg == "--shots") options.shots = std::stoul(value);
+    else if (arg == "--latency-us") options.latency_us = std::stod(value);
+    else if (arg == "--latency-tail-us") options.latency_tail_us = std::stod(value);
+    else if (arg == "--loss") options.loss = std::stod(value);
+    else if (arg == "--bandwidth-mbps") options.bandwidth_mbps = std::stod(value);
+    else if (arg == "--send-interval-us") options.send_interval_us = std::stol(value);
+    else if (arg == "--max-virtual-s") options.max_virtual_s = std::stod(value);
+    else if (arg == "--seed") options.seed = static_cast<uint32_t>(std::stoul(value));
+    else throw std::invalid_argument("Unknown option " + arg);
+  }
+  return options;
+}
+
+constexpr unsigned short base_port = 10000;
+
+class Simulation;
+
+/**
+ * Transport of a simulated node: sent datagrams become delivery events of the simulation
+ */
+class SimTransport : public Transport {
+public:
+  SimTransport(Simulation &sim, size_t node) : sim(sim), node(node) {}
+
+  void send(const Datagram *datagrams, size_t count) override;
+  ssize_t receive(size_t, char *, size_t, sockaddr_in &) override { return 0; } // the simulation delivers datagrams itself
+  void shutdown() override {}
+  void close() override {}
+
+private:
+  Simulation &sim;
+  size_t node;
+};
+
+class Simulation {
+public:
+  Simulation(const Options &options, size_t nb_nodes, uint32_t vs, uint32_t ds)
+    : options(options), nb_nodes(nb_nodes), vs(vs), ds(ds), rng(options.seed), 
+      link_free_at(nb_nodes * nb_nodes, 0), last_decision(nb_nodes, 0)
+  {
+    std::string ip = "127.0.0.1";
+    for (size_t i = 1; i <= nb_nodes; i++) {
+      hosts.emplace_back(i, ip, static_cast<unsigned short>(base_port + i));
+    }
+    for (size_t i = 0; i < nb_nodes; i++) {
+      nodes.push_back(std::make_unique<Node>(hosts, i + 1, "/dev/null", ds, std::make_unique<SimTransport>(*this, i), 
+                                             Tunables{}, [this]() { return virtualTime(); }));
+    }
+  }
+
+  void run()
+  {
+    auto wall_start = std::chrono::steady_clock::now();
+
+    // Every node proposes its shots back to back, starting at time 0
+    std::uniform_int_distribution<proposal_t> value(1, ds);
+    for (size_t i = 0; i < nb_nodes; i++) {
+      std::vector<std::set<proposal_t>> proposals(options.shots);
+      for (auto &proposal: proposals) {
+        while (proposal.size() < vs) proposal.insert(value(rng));
+      }
+      nodes[i]->proposeMany(std::move(proposals), [this, i](prop_nb_t, const std::set<proposal_t>&) {
+        decision_interval_us.record(static_cast<uint64_t>((now - last_decision[i]) / 1000));
+        last_decision[i] = now;
+        decided++;
+      });
+      nodes[i]->stepProposals();
+
+      // Stagger the sender loops
+      schedule(std::uniform_int_distribution<int64_t>(0, options.send_interval_us * 1000 - 1)(rng), Event::SEND, i, 0, {});
+    }
+
+    int64_t max_time = static_cast<int64_t>(options.max_virtual_s * 1e9);
+    while (!events.empty() && decided < nb_nodes * options.shots && now <= max_time) {
+      auto earliest = events.begin();
+      now = earliest->first;
+      Event event = std::move(earliest->second);
+      events.erase(earliest);
+
+      if (event.kind == Event::SEND) {
+        nodes[event.node]->sendPending();
+        schedule(now + options.send_interval_us * 1000, Event::SEND, event.node, 0, {});
+      } else {
+        sockaddr_in from = setupIpAddress(hosts[event.from]);
+        nodes[event.node]->receiveDatagram(event.data.data(), event.data.size(), from);
+        nodes[event.node]->stepProposals();
+      }
+    }
+
+    wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+  }
+
+  // Models the network between two nodes and schedules the delivery
+  void transmit(size_t from, const Datagram &datagram)
+  {
+    datagrams++;
+    bytes += datagram.len;
+    if (options.loss > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < options.loss) {
+      dropped++;
+      return;
+    }
+
+    size_t to = static_cast<size_t>(ntohs(datagram.dest.sin_port) - base_port - 1);
+    int64_t &free_at = link_free_at[from * nb_nodes + to];
+    int64_t start = std::max(now, free_at);
+    free_at = start + static_cast<int64_t>(static_cast<double>(datagram.len) * 8000.0 / options.bandwidth_mbps);
+
+    double latency_ns = 1000 * options.latency_us;
+    if (options.latency_tail_us > 0) latency_ns += 1000 * std::exponential_distribution<double>(1.0 / options.latency_tail_us)(rng);
+
+    schedule(free_at + static_cast<int64_t>(latency_ns), Event::DELIVER, to, from, 
+             std::vector<char>(datagram.data, datagram.data + datagram.len));
+  }
+
+  void report(std::ostream &os) const
+  {
+    // Protocol counters summed over the nodes
+    uint64_t instances = 0, rounds = 0, max_rounds = 0, acks = 0, nacks = 0;
+    Histogram decision_latency_us;
+    for (const auto &node: nodes) {
+      const LAMetrics &la = node->latticeAgreementMetrics();
+      decision_latency_us.add(la.decision_us);
+      instances += la.instances_decided.load();
+      rounds += la.rounds.load();
+      max_rounds = std::max(max_rounds, la.rounds_per_instance.max());
+      acks += la.acks_sent.load();
+      nacks += la.nacks_sent.load();
+    }
+    double virtual_s = static_cast<double>(now) / 1e9;
+    double per_decision = decided > 0 ? 1.0 / static_cast<double>(decided) : 0.0;
+
+    os << "{\"nodes\": " << nb_nodes << ", \"vs\": " << vs << ", \"ds\": " << ds << ", \"shots\": " << options.shots
+       << ", \"completed\": " << (decided == nb_nodes * options.shots ? "true" : "false")
+       << ", \"virtual_s\": " << virtual_s
+       << ", \"decisions\": " << decided
+       << ", \"datagrams\": " << datagrams << ", \"bytes\": " << bytes << ", \"dropped\": " << dropped
+       << ", \"datagrams_per_decision\": " << static_cast<double>(datagrams) * per_decision
+       << ", \"bytes_per_decision\": " << static_cast<double>(bytes) * per_decision
+       << ", \"mean_rounds\": " << (instances > 0 ? static_cast<double>(rounds) / static_cast<double>(instances) : 0.0)
+       << ", \"max_rounds\": " << max_rounds
+       << ", \"acks\": " << acks << ", \"nacks\": " << nacks
+       << ", \"decision_interval_us\": {\"p50\": " << decision_interval_us.percentile(0.5)
+       << ", \"p99\": " << decision_interval_us.percentile(0.99) << ", \"max\": " << decision_interval_us.max() << "}"
+       << ", \"decision_latency_us\": {\"p50\": " << decision_latency_us.percentile(0.5)
+       << ", \"p99\": " << decision_latency_us.percentile(0.99) << ", \"max\": " << decision_latency_us.max() << "}"
+       << ", \"wall_s\": " << wall_s << "}\n";
+  }
+
+private:
+  struct Event {
+    enum Kind { SEND, DELIVER };
+
+    Kind kind;
+    size_t node;
+    size_t from;
+    std::vector<char> data;
+  };
+
+  // Clock of the nodes
+  std::chrono::steady_clock::time_point virtualTime() const
+  {
+    return std::chrono::steady_clock::time_point(std::chrono::nanoseconds(now));
+  }
+
+  void schedule(int64_t time, Event::Kind kind, size_t node, size_t from, std::vector<char> &&data)
+  {
+    events.emplace(time, Event{kind, node, from, std::move(data)});
+  }
+
+private:
+  const Options &options;
+  size_t nb_nodes;
+  uint32_t vs;
+  uint32_t ds;
+  std::mt19937_64 rng;
+
+  std::vector<Parser::Host> hosts;
+  std::vector<std::unique_ptr<Node>> nodes;
+
+  std::multimap<int64_t, Event> events;  // by virtual time (ns), events of equal time run in schedule order
+  int64_t now = 0;
+  std::vector<int64_t> link_free_at;  // per directed link (from * nb_nodes + to)
+
+  std::vector<int64_t> last_decision;
+  size_t decided = 0;
+  Histogram decision_interval_us;     // virtual time between consecutive decisions of a node
+  uint64_t datagrams = 0, bytes = 0, dropped = 0;
+  double wall_s = 0;
+};
+
+void SimTransport::send(const Datagram *datagrams, size_t count)
+{
+  for (size_t i = 0; i < count; i++) sim.transmit(node, datagrams[i]);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options = parseOptions(argc, argv);
+
+  for (size_t nb_nodes: options.nodes) {
+    for (uint32_t vs: options.vs) {
+      for (uint32_t ds: options.ds) {
+        if (nb_nodes < 2 || vs > ds) continue;
+        Simulation sim(options, nb_nodes, vs, ds);
+        sim.run();
+        sim.report(std::cout);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * CPU placement of the node's threads by role, set with `--cpus ROLE=LIST` (e.g. `--cpus listener=2,3`,
+ * `--cpus worker=4-7`). The threads of a role are pinned round robin to the CPUs of its list, one CPU each;
+ * roles without a list are left to the scheduler.
+ *   sender     link senders (Node::send)
+ *   listener   receive loops, one per transport queue (Node::listen)
+ *   worker     lattice agreement message workers (Node::processMessages)
+ *   proposer   proposal loop (Node::processLatticeAgreement)
+ *   logger     decision log flush (Node::log)
+ */
+class CpuAffinity {
+public:
+  enum class Role { SENDER, LISTENER, WORKER, PROPOSER, LOGGER };
+
+  /**
+   * Sets the CPUs of a role from ROLE=LIST, LIST being comma separated CPUs or ranges
+   * @throws std::invalid_argument on unknown roles or malformed lists
+   */
+  void assign(const std::string &assignment);
+
+  bool empty() const;
+
+  // CPUs of a role, in assignment order (empty if unpinned)
+  const std::vector<int> &cpuList(Role role) const { return cpus[static_cast<size_t>(role)]; }
+
+  /**
+   * Pins the index-th thread of a role (no-op if the role has no CPUs)
+   * @return false if the kernel refused the placement (CPU offline or outside the process's cpuset)
+   */
+  bool pin(std::thread &thread, Role role, size_t index) const;
+
+  static const char *name(Role role);
+
+private:
+  static constexpr size_t nb_roles = 5;
+  std::array<std::vector<int>, nb_roles> cpus;
+};
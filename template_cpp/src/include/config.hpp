@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "globals.hpp"
+
+/**
+ * Proposals stored back to back in one buffer: proposal i holds values[offsets[i], offsets[i + 1])
+ */
+struct ProposalArena {
+  std::vector<proposal_t> values;
+  std::vector<size_t> offsets{0};
+
+  size_t size() const { return offsets.size() - 1; }
+  void clear();
+
+  const proposal_t *begin(size_t i) const { return values.data() + offsets[i]; }
+  size_t count(size_t i) const { return offsets[i + 1] - offsets[i]; }
+
+  // Builds the set of proposal i (duplicates in a line collapse, as in the config format)
+  std::set<proposal_t> toSet(size_t i) const;
+};
+
+/**
+ * Lattice agreement config reader.
+ * The file is memory mapped and parsed incrementally with std::from_chars,
+ * so a caller can read the proposals in batches while the node consumes them.
+ */
+class ConfigReader {
+public:
+  explicit ConfigReader(const std::string &path);
+  ~ConfigReader();
+
+  ConfigReader(const ConfigReader&) = delete;
+  ConfigReader& operator=(const ConfigReader&) = delete;
+
+  prop_nb_t shots() const { return shots_; }
+  uint32_t vs() const { return vs_; }
+  uint32_t ds() const { return ds_; }
+
+  /**
+   * Appends up to max_shots proposals to the arena (fewer once the shots of the header are read)
+   * @return Number of proposals appended
+   */
+  size_t read(ProposalArena &arena, size_t max_shots);
+
+  // Number of proposals not read yet
+  prop_nb_t remaining() const { return shots_ - read_shots; }
+
+private:
+  // Parses the unsigned integers of the current line into out, leaves pos at the start of the next line
+  template <typename Int>
+  bool parseLine(std::vector<Int> &out);
+
+private:
+  std::string path;
+  int fd = -1;
+  const char *data = nullptr;
+  size_t length = 0;
+  const char *pos = nullptr;
+
+  prop_nb_t shots_ = 0;
+  uint32_t vs_ = 0;
+  uint32_t ds_ = 0;
+  prop_nb_t read_shots = 0;
+};
@@ -5,9 +5,12 @@
 #include <vector>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
 #include <set>
+#include <string>
 
 #include "globals.hpp"
+#include "lock_profile.hpp"
 #include "message.hpp"
 
 // Concurrent deque
@@ -25,17 +28,27 @@ public:
 
   // Modifiers
   void push_back(const T& value);
+  void push_back(T&& value);
+  void push_back_all(std::vector<T>&& values);
   T pop_front();
   std::vector<T> pop_k_front(size_t k);
+  // Blocks until the deque is non-empty or the timeout expires, then pops up to k elements
+  std::vector<T> wait_pop_k_front(size_t k, std::chrono::milliseconds timeout);
   void clear();
+  // Blocks until the deque holds fewer than limit elements or the timeout expires
+  bool wait_size_below(size_t limit, std::chrono::milliseconds timeout);
 
   // Lookup
   T front() const;
   T back() const;
   std::vector<T> snapshot() const;
 
+private:
+  std::vector<T> pop_k_front_locked(size_t k);
+
 private:
   std::deque<T> deque_;
-  mutable std::mutex mutex_;
-  std::condition_variable cv_;
+  mutable Mutex mutex_{"ConcurrentDeque"};
+  ConditionVariable cv_;
+  ConditionVariable space_cv_; // notified on pops, for producers waiting on wait_size_below
 };
\ No newline at end of file
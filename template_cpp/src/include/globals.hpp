@@ -5,14 +5,65 @@ typedef uint32_t pkt_seq_t;
 typedef uint32_t proposal_t;
 typedef uint32_t prop_nb_t;
 
-constexpr uint32_t SEND_TIMEOUT_MS = 0;      // 5
+// Defaults of the runtime tunables (see Tunables: --tune NAME=VALUE, --tuning FILE)
+constexpr uint32_t SEND_TIMEOUT_MS = 0;      // minimum pause between sender rounds (pacing decides the rest)
 constexpr uint32_t LOG_TIMEOUT = 2000;
-constexpr uint32_t PROPOSAL_TIMEOUT_MS = 10; // TODO: reduce this
-
-constexpr uint32_t MAX_MESSAGES_PER_PACKET = 8; // 8
-constexpr uint32_t SEND_WINDOW_SIZE = 32;        // 8
-constexpr uint32_t MAX_CONTAINER_SIZE =  MAX_MESSAGES_PER_PACKET * SEND_WINDOW_SIZE;
+constexpr uint32_t MESSAGES_PER_PACKET = 8;
+constexpr uint32_t SEND_WINDOW_SIZE = 32;       // packets per link and round
 constexpr uint32_t BROADCAST_COOLDOWN_MS = 0;
+
+constexpr uint32_t LOG_BUFFER_BYTES = 1 << 20;  // preallocated decision buffer (x2)
+constexpr uint32_t LOG_FLUSH_BYTES = 1 << 18;   // write out early once this much is buffered
+
+constexpr uint32_t MAX_MESSAGES_PER_PACKET = 16; // packet capacity (wire format), bound of the messages_per_packet tunable
+constexpr uint32_t MAX_SEND_WINDOW_SIZE = 1024;  // bound of the send_window tunable
+constexpr uint32_t MAX_CONTAINER_SIZE =  MESSAGES_PER_PACKET * SEND_WINDOW_SIZE; // pending messages per link with the defaults
 constexpr uint32_t MAX_PROPOSAL_SET_SIZE = 1000;
+constexpr uint32_t PROPOSAL_QUEUE_LIMIT = 256;  // proposals waiting for the LA engine before the config reader blocks
+constexpr uint32_t CONFIG_READ_BATCH = 64;      // proposals parsed per config read
+
+// Sending (links are partitioned over the sender threads by backlog)
+constexpr uint32_t SENDER_THREADS = 1;        // raise on hosts with spare cores
+constexpr uint32_t SEND_BATCH_SIZE = 64;        // datagrams per sendmmsg
+constexpr uint32_t UDP_GSO_MAX_SEGMENT = 1472;  // largest datagram sent segmented (UDP payload of a 1500 bytes MTU)
+constexpr uint32_t UDP_GSO_MAX_SEGMENTS = 64;   // kernel limit per UDP_SEGMENT send
+constexpr uint32_t BUSY_POLL_SPIN_US = 2000;   // busy-poll mode: empty spin before a listener blocks until the next datagram
+constexpr uint32_t SENDER_REBALANCE_MS = 100;
+
+// Send pacing: AIMD on the rate of the send rounds of each link (a round sends the first window of pending messages)
+constexpr double PACING_INITIAL_RATE = 2000;      // rounds per second
+constexpr double PACING_MIN_RATE = 20;
+constexpr double PACING_MAX_RATE = 20000;
+constexpr double PACING_RATE_INCREASE = 100;      // after a round acknowledged since the previous one
+constexpr double PACING_DECREASE_FACTOR = 0.5;    // after a round retransmitting without acks, or on receive pressure
+constexpr uint32_t PACING_FEEDBACK_MS = 1;        // sampling of the node's receive drops and queue fill
+constexpr double PACING_QUEUE_HIGH = 0.5;         // receive queue fill above which the senders slow down
+constexpr uint32_t PACING_IDLE_WAIT_US = 500;     // sender wait when no link has messages to send
+
+// Shared-memory transport (--transport shm)
+constexpr uint32_t SHM_RING_BYTES = 1 << 18;     // per ordered pair of local processes, as a UDP receive buffer
+constexpr uint32_t SHM_OPEN_RETRY_MS = 100;      // peers whose region does not exist yet are reached over UDP meanwhile
+
+// io_uring engine (--io uring)
+constexpr uint32_t URING_RECV_BUFFERS = 64;      // provided receive buffers per socket (power of two)
+constexpr uint32_t URING_WAIT_MS = 100;          // listener wait between checks of the shutdown flag
+
+// Traffic trace (--trace)
+constexpr uint32_t TRACE_BUFFER_BYTES = 1 << 20; // records buffered before a write
+
+constexpr int INITIAL_SLIDING_SET_PREFIX = 0; 
+
+// Lattice agreement message processing (messages are sharded over the workers by instance)
+constexpr uint32_t LA_WORKER_THREADS = 2;
+constexpr uint32_t LA_WORKER_BATCH = 64;
+constexpr uint32_t LA_WORKER_WAIT_MS = 10;
+
+// Lattice agreement instance table
+constexpr uint32_t LA_INSTANCE_SHARDS = 16;
+constexpr uint32_t LA_INSTANCE_WINDOW = 1 << 22;  // instances above the freed ones that may exist (bounds a bad instance id)
+
+// Lattice agreement garbage collection
+constexpr uint32_t LA_SUSPECT_TIMEOUT_MS = 10000;     // peers silent for longer do not hold back the low-watermark
 
-constexpr int INITIAL_SLIDING_SET_PREFIX = 0; 
\ No newline at end of file
+// Metrics (dumped to <output>.metrics periodically and on SIGUSR1)
+constexpr uint32_t METRICS_INTERVAL_MS = 1000;
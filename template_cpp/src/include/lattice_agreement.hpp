@@ -3,13 +3,44 @@
 #include <algorithm>
 #include <stdint.h>
 #include <set>
-
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <ostream>
+
+#include "config.hpp"
 #include "globals.hpp"
+#include "lock_profile.hpp"
 #include "maps.hpp"
 #include "message.hpp"
+#include "metrics.hpp"
 
 class Node; 
 
+/**
+ * Callback invoked with the decided set of a lattice agreement instance
+ */
+using DecisionCallback = std::function<void(prop_nb_t instance, const std::set<proposal_t>& decision)>;
+
+/**
+ * Proposal waiting to be proposed in its lattice agreement instance
+ */
+struct Proposal {
+  prop_nb_t instance;
+  std::set<proposal_t> values;
+  DecisionCallback on_decide;
+  std::chrono::steady_clock::time_point queued_at;  // on the clock of the node
+  std::shared_ptr<const ProposalArena> arena = nullptr;  // if set, the values are proposal arena_index of the arena
+  size_t arena_index = 0;
+
+  // The values to propose, built from the arena by the thread proposing them
+  std::set<proposal_t> takeValues() { return arena ? arena->toSet(arena_index) : std::move(values); }
+};
+
 // Lattice agreement instance
 class LatticeAgreementInstance {
 public:
@@ -19,26 +50,51 @@ public:
 
   /**
    * process the message
-   * @return True if the instance should be destroyed (has acknowledged proposals of all other nodes). False otherwise
+   * @return false if the instance has been retired, in which case the message was not processed
    */
   bool processMessage(std::shared_ptr<const Message> msg, std::string sender_ip_and_port);
   void propose(std::set<proposal_t> proposal);
-  void waitUntilDecidedOrTerminated();
+
+  /**
+   * Block until decided or terminated
+   * @return The decided set (only returned to the first caller), or nothing if terminated before deciding
+   */
+  std::optional<std::set<proposal_t>> waitUntilDecidedOrTerminated();
+
+  /**
+   * Non-blocking variant of waitUntilDecidedOrTerminated
+   * @return The decided set (only returned to the first caller), or nothing if not decided yet
+   */
+  std::optional<std::set<proposal_t>> pollDecision();
   void terminate();
 
+  /**
+   * Approximate number of heap bytes held by this instance (including the object itself)
+   */
+  size_t memoryFootprint();
+
+  /**
+   * Stop processing messages and hand the acceptor state over (see LatticeAgreement::collectGarbage)
+   * @return The accepted set
+   */
+  std::vector<proposal_t> retire();
+
+  /**
+   * Respond to the sender of a proposal with ACK, or NACK carrying the accepted set
+   */
+  static void respond(Node *parent, const Message& msg, const std::string& sender_ip_and_port, 
+                      const std::vector<proposal_t>& accepted, bool acknowledge);
+
 private:
   /**
    * Create message and broadcast
    */
   void broadcastProposal();
 
-  /**
-   * Respond to sender with ACK or NACK
-   */
-  void respond(std::shared_ptr<const Message> msg, std::string sender_ip_and_port, bool acknoledge);
 
   /**
    * Decide on a set of values (unblocks waitUntilDecided)
+   * Once decided, the proposer state is released and only the acceptor state is kept.
    */
   void decide();
 
@@ -47,11 +103,17 @@ private:
    */
   void updateProposal();
 
+  /**
+   * Records the latency of the first ACK/NACK to the own proposal
+   */
+  void recordFirstResponse();
+
 private:
   prop_nb_t instance_id;
   bool has_proposal = false;
-  std::mutex la_mutex;
+  Mutex la_mutex{"LatticeAgreementInstance"};
   bool terminated = false;
+  bool retired = false;
 
   // Proposer
   bool active = false;
@@ -59,14 +121,16 @@ private:
   uint32_t nack_count = 0;
   uint32_t active_proposal_number = 0;
   std::set<proposal_t> proposed_values;
+  std::chrono::steady_clock::time_point proposed_at;
+  bool responded = false;  // a response to the own proposal has been received
 
   bool decided = false;
-  std::mutex decision_mutex;
-  std::condition_variable decision_cv;
+  std::set<proposal_t> decision;
+  Mutex decision_mutex{"LatticeAgreementInstance::decision"};
+  ConditionVariable decision_cv;
 
-  // Acceptor
-  std::set<proposal_t> accepted_values;
-  size_t acknowledgements_sent;
+  // Acceptor (sorted, duplicate free)
+  std::vector<proposal_t> accepted_values;
 
   size_t nb_nodes;
   uint32_t distinct_values;
@@ -91,23 +155,65 @@ public:
 
   /**
    * Wait unitl lattice agreement instance has decided (block until decided)
+   * @return The decided set, or nothing if terminated (or already freed) before deciding
+   */
+  std::optional<std::set<proposal_t>> waitUntilDecidedOrTerminated(prop_nb_t instance_id);
+
+  /**
+   * Decided set of an instance if it has decided (see LatticeAgreementInstance::pollDecision)
    */
-  void waitUntilDecidedOrTerminated(prop_nb_t instance_id);
+  std::optional<std::set<proposal_t>> pollDecision(prop_nb_t instance_id);
 
   /**
    * Terminate this lattice agreement manager
    */
   void terminate();
 
+  /**
+   * Writes the lattice agreement counters and the number of live instances, one `la.<name> <value>` line each.
+   */
+  void writeMetrics(std::ostream& os);
+
+  // Updated by the instances
+  LAMetrics metrics;
+
 private:
   /**
-   * Try adding new instance to deque, if already exists do nothing
+   * Get the instance, creating it if it does not exist yet (nullptr if it has been freed)
+   */
+  std::shared_ptr<LatticeAgreementInstance> getInstance(prop_nb_t instance_id);
+
+  /**
+   * Record that a node is alive and, for proposer messages, that it has decided every instance before msg->instance
+   */
+  void updatePeerProgress(proc_id_t node_id, const Message& msg);
+
+  /**
+   * Free every instance below the low-watermark, i.e. instances that no unsuspected node can still propose in.
+   * Their acceptor state is kept until every node, suspected or not, has moved past them.
+   */
+  void collectGarbage();
+
+  /**
+   * Answer a proposal in a freed instance from its retired acceptor state
+   * @return false if no state is kept for the instance (every node has decided it)
    */
-  void tryAddingInstance(prop_nb_t instance_id);
+  bool processRetired(const std::shared_ptr<const Message>& msg, const std::string& sender_ip_and_port);
 
 private:
-  std::map<prop_nb_t, std::unique_ptr<LatticeAgreementInstance>> instances;
-  std::mutex la_manager_mutex;
+  // Instances indexed by id, instances below the window base (low-watermark) have been freed
+  ShardedWindowMap<prop_nb_t, LatticeAgreementInstance> instances;
+  std::atomic_bool terminated{false};
+
+  // Garbage collection
+  // Accepted set of the freed instances that a suspected node may still propose in, by instance. A suspected node 
+  // may only be slow or stopped: its proposals must still be answered consistently with what was accepted.
+  std::map<prop_nb_t, std::vector<proposal_t>> retired;
+  Mutex retired_mutex{"LatticeAgreement::retired"};
+  std::vector<std::atomic<prop_nb_t>> node_progress;  // highest instance proposed by each node (index: id - 1)
+  std::vector<std::atomic<int64_t>> node_last_heard;  // node clock time (ns) of the last message received from each node
+  std::atomic<uint64_t> created_instances{0};
+  std::atomic<uint64_t> freed_instances{0};  // written by the proposer thread, read by writeMetrics
 
   size_t nb_nodes;
   uint32_t distinct_values;
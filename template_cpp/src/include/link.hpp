@@ -1,6 +1,7 @@
 #pragma once
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <string.h>
 #include <cstring>
 #include <vector>
@@ -13,6 +14,8 @@
 #include <errno.h>
 #include <memory>
 #include <utility>
+#include <atomic>
+#include <chrono>
 
 #include "parser.hpp"
 #include "message.hpp"
@@ -20,20 +23,88 @@
 #include "sets.hpp"
 #include "maps.hpp"
 #include "deque.hpp"
+#include "metrics.hpp"
+#include "transport.hpp"
+#include "trace.hpp"
+#include "tunables.hpp"
 
 
+/**
+ * Batch of datagrams handed over to the transport at once (a single sendmmsg call over UDP). 
+ * Each sender thread owns one batch: packets are serialized directly into its arena, 
+ * which keeps its capacity between flushes.
+ */
+class SendBatch {
+public:
+  SendBatch(Transport& transport);
+
+  /**
+   * Serializes a packet at the end of the batch, flushing the batch first if it is full.
+   * @param packet Packet to send
+   * @param dest Destination address
+   * @return Serialized size of the packet
+   */
+  size_t add(const Packet& packet, const sockaddr_in& dest);
+
+  /**
+   * Sends all datagrams of the batch.
+   */
+  void flush();
+
+private:
+  Transport& transport;
+  std::vector<char> arena;
+  std::vector<size_t> offsets;
+  std::vector<Datagram> datagrams;
+};
+
+/**
+ * AIMD pacing of the send rounds of a link. The rate grows additively with every round acknowledged since the 
+ * previous one, and is cut multiplicatively when a round retransmits without any acknowledgement (loss) 
+ * or when the node's receive queues fill up.
+ */
+class SendPacer {
+public:
+  using clock = std::chrono::steady_clock;
+
+  bool due(clock::time_point now) const;
+  clock::time_point nextRound() const;
+
+  /**
+   * Adapts the rate after a round and schedules the next one.
+   * @param acked Acknowledgements were received since the previous round
+   * @param lost The round retransmitted messages and no acknowledgement was received since the previous round
+   */
+  void roundSent(clock::time_point now, bool acked, bool lost);
+
+  /**
+   * Multiplicative decrease
+   * @return false if the rate already is the minimum
+   */
+  bool slowDown();
+
+  double rate() const { return rate_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<double> rate_{PACING_INITIAL_RATE};   // rounds per second
+  std::atomic<int64_t> next_round_{0};              // clock ticks
+};
+
 /**
  * Base class representing the endpoints of a perfect link implementation with send and receive capabilities.
  */
 class PerfectLink {
   public:
   /**
-   * Constructor to initialize the PerfectLink with a socket and its send and receive addresses.
-   * @param socket The UDP socket used for communication.
+   * Constructor to initialize the PerfectLink with a transport and its send and receive addresses.
+   * @param transport The transport of the node (UDP socket or in-memory network).
    * @param source_addr The address to which packets will be sent.
    * @param dest_addr The address from which packets will be received.
+   * @param peer Id of the process at dest_addr (reported by the tracepoints)
+   * @param tunables Send window and messages per packet of the rounds
    */
-  PerfectLink(int socket, sockaddr_in source_addr, sockaddr_in dest_addr);
+  PerfectLink(Transport& transport, sockaddr_in source_addr, sockaddr_in dest_addr, proc_id_t peer = 0,
+              const Tunables& tunables = {});
   
   /**
    * Enqueues a packet to be sent later.
@@ -43,9 +114,44 @@ class PerfectLink {
   
   /**
   * Send the first enqueued packets.
-  * @throws std::runtime_error if sending fails.
+  * May briefly be called by two sender threads after the links are rebalanced: it only touches locked state.
+  * @param batch Batch of the calling sender thread to which the packets are added
+  * @return The number of messages retransmitted
   */
-  void send();
+  size_t send(SendBatch& batch);
+
+  /**
+   * Sends a round (see send) if the pacer allows it at now, and adapts the pacing.
+   */
+  void sendPaced(SendBatch& batch, SendPacer::clock::time_point now);
+
+  /**
+   * Slows the pacing down (receive pressure on the node)
+   */
+  void slowDown();
+
+  /**
+   * Records every packet sent from now on (nullptr stops recording). The writer must outlive the link.
+   */
+  void setTrace(TraceWriter *writer) { trace = writer; }
+
+  /**
+   * Time of the next paced round
+   */
+  SendPacer::clock::time_point nextRound() const { return pacer.nextRound(); }
+
+  /**
+   * Number of messages waiting to be sent or acknowledged.
+   */
+  size_t backlog() const;
+
+  // Id of the process at the other end
+  proc_id_t peerId() const { return peer; }
+
+  /**
+   * Writes the link counters and its queue and pending depths, one `<prefix>.<name> <value>` line each.
+   */
+  void writeMetrics(std::ostream& os, const std::string& prefix) const;
 
   /** 
     * Receive ACK from receiver and removed corresponding packet from queue.
@@ -53,22 +159,30 @@ class PerfectLink {
     * Add packet to delivered list, send ACK to sender, and return true if packet was not already delivered. Otherwise, return false.
     * @param packet The packet to respond to.
     */
-  std::array<bool, MAX_MESSAGES_PER_PACKET> receive(Packet packet);
+  std::array<bool, MAX_MESSAGES_PER_PACKET> receive(const Packet& packet);
 
 private:
-  int socket;
+  Transport& transport;
   sockaddr_in source_addr;
   sockaddr_in dest_addr;
+  proc_id_t peer;
+  TraceWriter *trace = nullptr;
 
-  // Sending
-  pkt_seq_t link_seq = 0;
+  // Sending (messages are enqueued concurrently by the lattice agreement threads)
+  std::atomic<pkt_seq_t> link_seq{0};
   
   ConcurrentDeque<std::pair<pkt_seq_t, std::shared_ptr<Message>>> packet_queue;
   ConcurrentMap<pkt_seq_t, std::shared_ptr<Message>> pending_pkts;
+  std::atomic<pkt_seq_t> max_sent_seq{0}; // highest sequence number sent so far (lower ones are retransmissions)
+  SendPacer pacer;
+  std::atomic_bool acked_since_round{false};
   
   // Reception
   SlidingSet<pkt_seq_t> delivered_pkts;
+
+  LinkMetrics metrics;
   
 public:
-  static constexpr uint32_t window_size = SEND_WINDOW_SIZE; 
+  const uint32_t window_size;           // packets per round
+  const uint32_t messages_per_packet;
 };
\ No newline at end of file
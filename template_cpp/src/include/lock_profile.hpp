@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+#include "metrics.hpp"
+
+/**
+ * Mutex of the engine's internal locks, named after its role (all instances sharing a name are reported together).
+ *
+ * Built with -DDA_LOCK_PROFILING=ON, every lock records its acquisitions, contended acquisitions (those that had to
+ * wait), and its wait and hold times, and a summary ranked by wait time is printed on stderr at exit.
+ * Otherwise Mutex is a std::mutex and the name is dropped: the instrumentation costs nothing.
+ *
+ * Condition variables must be ConditionVariable, waited on with a MutexLock.
+ */
+#ifdef DA_LOCK_PROFILING
+
+struct LockStats {
+  const char *name;
+  Counter acquisitions;
+  Counter contended;
+  Counter wait_ns;
+  Counter hold_ns;
+};
+
+class Mutex {
+public:
+  explicit Mutex(const char *name);
+  Mutex(const Mutex&) = delete;
+  Mutex& operator=(const Mutex&) = delete;
+
+  void lock();
+  bool try_lock();
+  void unlock();
+
+private:
+  std::mutex mutex;
+  LockStats &stats;
+  std::chrono::steady_clock::time_point locked_at;  // written by the holder only
+};
+
+using MutexLock = std::unique_lock<Mutex>;
+using ConditionVariable = std::condition_variable_any;
+
+/**
+ * Writes the statistics of every named lock, ranked by total wait time.
+ */
+void writeLockProfile(std::ostream &os);
+
+#else
+
+class Mutex : public std::mutex {
+public:
+  explicit constexpr Mutex(const char *) noexcept {}
+};
+
+using MutexLock = std::unique_lock<std::mutex>;
+using ConditionVariable = std::condition_variable;
+
+inline void writeLockProfile(std::ostream &) {}
+
+#endif
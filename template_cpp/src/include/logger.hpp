@@ -6,31 +6,46 @@
 #include <condition_variable>
 #include <vector>
 #include <atomic>
-#include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
 #include <set>
 
 #include "globals.hpp"
+#include "lock_profile.hpp"
 
 class Logger {
 public:
   explicit Logger(const std::string &path);
   ~Logger();
 
-  void logDecision(std::set<proposal_t>& proposals);
+  /**
+   * Formats a decision into the append buffer (no allocation unless the buffer has to grow).
+   * Wakes up the writer once LOG_FLUSH_BYTES are buffered.
+   */
+  void logDecision(const std::set<proposal_t>& proposals);
+
+  /**
+   * Blocks until LOG_FLUSH_BYTES are buffered, the timeout expires or wakeUp is called.
+   */
+  void waitForFlush(std::chrono::milliseconds timeout);
+  void wakeUp();
   
   void write();
-  void flush();
   void cleanup();
   
-  private:
-  void enqueueLine(const std::string &line);
+private:
+  // Append buffer: data keeps its size, only the first `used` bytes are filled
+  struct Buffer {
+    std::vector<char> data;
+    size_t used = 0;
+  };
 
-  std::ofstream log_file;
-  std::vector<std::string> queue;
-  std::mutex mutex;
-  std::condition_variable cv;
-  std::atomic_bool running{false};
-  std::thread worker;
-};
\ No newline at end of file
+  int fd = -1;
+  Buffer active;      // decisions are formatted here
+  Buffer spare;       // written to the file while the other buffer fills up
+  bool wake_up = false;
+  Mutex mutex{"Logger"};
+  Mutex write_mutex{"Logger::write"};
+  ConditionVariable cv;
+};
@@ -7,8 +7,13 @@
 #include <functional>
 #include <condition_variable>
 #include <set> // for template instantiation
+#include <array>
+#include <deque>
+#include <memory>
+#include <atomic>
 
 #include "globals.hpp"
+#include "lock_profile.hpp"
 #include "deque.hpp"
 
 // Concurrent map wrapper around std::map
@@ -33,9 +38,11 @@ public:
   std::pair<iterator, bool> insert(const Key &key, const Value &value);
   void erase(const Key &key);
   void erase(const std::vector<Key> &keys);
-  void erase(const std::array<Key, MAX_MESSAGES_PER_PACKET>& keys);
+  std::size_t erase(const std::array<Key, MAX_MESSAGES_PER_PACKET>& keys); // returns the number of keys erased
 
-  std::pair<std::array<value_type, MAX_CONTAINER_SIZE>, size_t> complete(ConcurrentDeque<std::pair<Key, Value>>& queue);
+  // Tops the map up to limit elements from the front of queue, and copies it (in key order) into snapshot.
+  // Returns the size of the snapshot.
+  std::size_t complete(ConcurrentDeque<std::pair<Key, Value>>& queue, std::size_t limit, std::vector<std::pair<Key, Value>>& snapshot);
 
   // Convenience helpers for when Value is a container (eg std::set<proc_id_t>):
   // Insert a member into the mapped container. If key does not exist, create it.
@@ -54,11 +61,65 @@ public:
   bool contains(const Key &key) const;
   std::vector<value_type> snapshot() const;
 
-public:
-  static constexpr size_t max_size = MAX_CONTAINER_SIZE;
-
 private:
   bool bounded_;
   map_type map_;
-  mutable std::mutex mutex_;
+  mutable Mutex mutex_{"ConcurrentMap"};
+};
+
+/**
+ * Sliding window of shared elements indexed by an increasing integer key (eg a lattice agreement instance id).
+ * Keys are spread over independently locked shards (key % nb_shards) and each shard stores its elements 
+ * in a deque indexed by key / nb_shards - first, so that operations on different keys do not contend on one lock.
+ * Elements below the window base have been freed and are never created again.
+ */
+template <typename Key, typename T>
+class ShardedWindowMap {
+public:
+  using key_type = Key;
+  using pointer = std::shared_ptr<T>;
+  using factory_type = std::function<pointer(const Key&)>;
+
+  ShardedWindowMap() = default;
+  ShardedWindowMap(factory_type make);
+  ~ShardedWindowMap() = default;
+
+  // Capacity methods
+  std::size_t size() const;
+  Key base() const;
+
+  // Modifiers
+  /**
+   * Return the element for key, creating it with the factory if absent.
+   * @return The element (nullptr if key is below the window base, or max_window or more above it) and whether 
+   * it was created.
+   */
+  std::pair<pointer, bool> get_or_create(const Key &key);
+
+  /**
+   * Slide the window base up to new_base, freeing every element below it.
+   * @param on_free Called with each element before it is released (with its shard locked)
+   * @return The number of freed elements.
+   */
+  std::size_t advance_base(const Key &new_base, const std::function<void(const Key&, T&)>& on_free = nullptr);
+
+  // Lookup
+  pointer find(const Key &key) const;
+  void for_each(const std::function<void(const Key&, T&)>& fn) const;
+
+public:
+  static constexpr size_t nb_shards = LA_INSTANCE_SHARDS;
+  static constexpr size_t max_window = LA_INSTANCE_WINDOW;  // keys the window spans above its base
+
+private:
+  struct Shard {
+    mutable Mutex mutex_{"ShardedWindowMap"};
+    Key first = 0;              // key / nb_shards of slots.front()
+    std::deque<pointer> slots;
+    std::size_t count = 0;      // non-null slots
+  };
+
+  factory_type make_;
+  std::array<Shard, nb_shards> shards_;
+  std::atomic<Key> base_{0};
 };
\ No newline at end of file
@@ -29,11 +29,19 @@ public:
   // Constructor
   Message() = default;
   Message(MessageType type, prop_nb_t instance, prop_nb_t round, const std::set<proposal_t>& proposal_set);
+  Message(MessageType type, prop_nb_t instance, prop_nb_t round, std::vector<proposal_t> sorted_values);
+
+  // Copies do not share the encoding of the original, so that they can be modified before being sent
+  Message(const Message& other);
+  Message& operator=(const Message& other);
+  Message(Message&& other) = default;
+  Message& operator=(Message&& other) = default;
+
   bool operator==(const Message& other) const;
 
   // Response generation
   Message toAck() const;
-  Message toNack(std::set<proposal_t>& completed_proposal_set) const;
+  Message toNack(const std::vector<proposal_t>& completed_proposal_set) const;
 
   // helper to display
   void displayMessage() const;
@@ -41,7 +49,23 @@ public:
   // Serialization methods
   size_t serializedSize() const;
   void serializeTo(char* buffer, size_t& offset) const;
-  static Message deserialize(const char * buffer, size_t& offset);
+  /**
+   * Decode the message at buffer + offset, advancing offset past it
+   * @param len Size of the buffer: reads never go past it
+   * @throws std::runtime_error if the message is truncated or malformed
+   */
+  static Message deserialize(const char * buffer, size_t len, size_t& offset);
+
+  /**
+   * Encoded bytes of the message, computed on first use and then shared by every link and retransmission.
+   * A message must not be modified once it has been encoded (copies may, see the copy constructor).
+   */
+  const std::vector<char>& wireImage() const;
+
+private:
+  void encodeTo(char* buffer, size_t& offset) const;
+
+  mutable std::shared_ptr<const std::vector<char>> wire_;
 
 public:
   MessageType type;
@@ -49,7 +73,7 @@ public:
   prop_nb_t round;
   std::vector<proposal_t> proposed_values;
 
-  static constexpr size_t max_serialized_size = sizeof(instance) + sizeof(type) + sizeof(round) + sizeof(proposal_t) * MAX_PROPOSAL_SET_SIZE;
+  static constexpr size_t max_serialized_size = sizeof(instance) + sizeof(type) + sizeof(round) + sizeof(uint16_t) + sizeof(proposal_t) * MAX_PROPOSAL_SET_SIZE;
 };
 
 // ======================== Link packet class ======================== 
@@ -62,6 +86,7 @@ struct MesPayload {
  * Class representing a network packet with serialization and deserialization capabilities.
  * Packets of type MES contain a list of tuples of link sequence number, pointer to Message objects.
  * Packets of type ACK contain a list of link sequence numbers being acknowledged. 
+ * Packets only hold their header and message pointers, they are serialized into a buffer supplied by the caller.
  */
 class Packet {
 public:
@@ -82,15 +107,25 @@ public:
   // For all packets
   const std::array<pkt_seq_t, MAX_MESSAGES_PER_PACKET>& getSeqs() const;
 
-  Packet toAck();
+  Packet toAck() const;
   size_t serializedSize() const;
 
   // Debugging functions for displaying packets
   void displayPacket();
-  static void displaySerialized(const char* serialized);
+  static void displaySerialized(const char* serialized, size_t len);
+
+  /**
+   * Serialize the packet into buffer, which must hold at least serializedSize() bytes.
+   * @return The number of bytes written
+   */
+  size_t serialize(char * buffer) const;
 
-  const char * serialize() const;
-  static Packet deserialize(const char * buffer);
+  /**
+   * Decode the packet at the start of buffer (bytes after it, such as segmentation padding, are ignored)
+   * @param len Size of the buffer (datagram): reads never go past it
+   * @throws std::runtime_error if the packet is truncated, has an unknown type or too many messages
+   */
+  static Packet deserialize(const char * buffer, size_t len);
 
   static constexpr size_t max_msgs = MAX_MESSAGES_PER_PACKET;
   static constexpr size_t pkt_max_serialized_size = sizeof(MessageType) + sizeof(uint8_t) +  max_msgs * (sizeof(pkt_seq_t) + Message::max_serialized_size);
@@ -103,8 +138,6 @@ private:
 
   // sequence numbers and messages for MES packets or sequence numbers for ACK packets
   std::variant<MesPayload, std::array<pkt_seq_t, MAX_MESSAGES_PER_PACKET>> payload;
-
-  mutable std::array<char, max_serialized_size> serialized_buffer;
 };
 
 // Helper functions to choose the right conversion based on size
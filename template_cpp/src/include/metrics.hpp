@@ -0,0 +1,121 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+/**
+ * Monotonic event counter.
+ * Increments are relaxed: counters are only read to be reported, never to synchronize threads.
+ */
+class Counter {
+public:
+  void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t load() const { return value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> value{0};
+};
+
+/**
+ * Time source of the engine: the steady clock, or the virtual clock of a simulation driving it
+ */
+using Clock = std::function<std::chrono::steady_clock::time_point()>;
+
+// Elapsed time for the latency histograms
+inline uint64_t microsecondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+}
+
+inline uint64_t microsecondsSince(std::chrono::steady_clock::time_point start)
+{
+  return microsecondsBetween(start, std::chrono::steady_clock::now());
+}
+
+/**
+ * Log-linear histogram (HDR style): every power of two is split into 2^sub_bits linear buckets,
+ * so a recorded value is known to ~3% and values below 2^(sub_bits + 1) exactly.
+ * Recording is lock-free (relaxed atomics); reads are only consistent once recording has stopped.
+ */
+class Histogram {
+public:
+  static constexpr unsigned sub_bits = 5;
+  static constexpr size_t sub_count = size_t{1} << sub_bits;
+  static constexpr size_t nb_buckets = (64 - sub_bits + 1) * sub_count;
+
+  void record(uint64_t value);
+
+  /**
+   * Records every value recorded by other (e.g. to summarize the histograms of several nodes)
+   */
+  void add(const Histogram& other);
+
+  uint64_t count() const;
+  uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+  /**
+   * Value at quantile q (upper bound of the bucket holding it), 0 if the histogram is empty.
+   * @param q Quantile in [0, 1]
+   */
+  uint64_t percentile(double q) const;
+
+  /**
+   * Writes `<name>.count`, `<name>.p50`, `<name>.p99`, `<name>.p999` and `<name>.max` lines.
+   */
+  void writeSummary(std::ostream& os, const std::string& name) const;
+
+  /**
+   * Writes one `<name>.<value> <count>` line per non-empty bucket (value: upper bound of the bucket).
+   */
+  void writeDistribution(std::ostream& os, const std::string& name) const;
+
+private:
+  static size_t bucketOf(uint64_t value);
+  static uint64_t bucketUpperBound(size_t bucket);
+
+private:
+  std::array<std::atomic<uint64_t>, nb_buckets> buckets{};
+  std::atomic<uint64_t> max_{0};
+};
+
+// Per perfect link (queue and pending depths are read from the link when reporting)
+struct LinkMetrics {
+  Counter packets_sent;
+  Counter bytes_sent;
+  Counter messages_retransmitted;  // messages sent again because they were not acknowledged yet
+  Counter messages_acked;
+  Counter acks_sent;
+  Counter rate_decreases;          // multiplicative decreases of the send pacing
+};
+
+// Per node (reception path)
+struct NodeMetrics {
+  Counter recv_calls;
+  Counter bytes_received;
+  Counter duplicates_dropped;      // messages already delivered by the perfect link
+  Counter decode_errors;           // packets Packet::deserialize rejected
+  Counter unknown_senders;
+};
+
+// Per lattice agreement (live instances are read from the instance map when reporting)
+struct LAMetrics {
+  Counter instances_decided;
+  Counter rounds;                  // sum over decided instances, divide by instances_decided for the mean
+  Counter acks_received;
+  Counter nacks_received;
+  Counter acks_sent;
+  Counter nacks_sent;
+
+  // Instance latencies in microseconds: queued -> proposed -> first response -> decided
+  Histogram queue_wait_us;
+  Histogram first_response_us;
+  Histogram decision_us;       // proposed -> decided
+  Histogram end_to_end_us;     // queued -> decided
+  Histogram rounds_per_instance;
+};
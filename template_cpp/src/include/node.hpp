@@ -14,6 +14,11 @@
 #include <thread>
 #include <atomic>
 #include <queue>
+#include <future>
+#include <mutex>
+#include <algorithm>
+#include <optional>
+#include <cstdio>
 
 #include "globals.hpp"
 #include "helper.hpp"
@@ -24,6 +29,10 @@
 #include "logger.hpp"
 #include "sets.hpp"
 #include "maps.hpp"
+#include "transport.hpp"
+#include "trace.hpp"
+#include "tunables.hpp"
+#include "affinity.hpp"
 
 /**
  * Implementation of a network node that can send and receive messages.
@@ -36,8 +45,15 @@ public:
    * @param id The unique identifier for this node.
    * @param receiver_id The unique identifier for the network's receiver node.
    * @param outputPath The path to the output file where messages will be logged.
+   * @param transport Transport of the node, a UDP socket bound to the node's address by default.
+   * @param tunables Protocol parameters (send window, packet size, timeouts)
+   * @param clock Time source of the latency metrics, the peer suspicion of the garbage collection and the pacing
+   *   of sendPending. The threads started by start() sleep on the steady clock, so a virtual clock is only meant
+   *   for nodes driven by stepProposals, sendPending and receiveDatagram.
    */
-  Node(std::vector<Parser::Host> nodes, proc_id_t id, std::string outputPath, uint32_t ds);
+  Node(std::vector<Parser::Host> nodes, proc_id_t id, std::string outputPath, uint32_t ds, 
+       std::unique_ptr<Transport> transport = nullptr, Tunables tunables = {}, 
+       Clock clock = std::chrono::steady_clock::now);
   
   // Destructor
   ~Node();
@@ -62,7 +78,94 @@ public:
    */
   void terminate();
 
-  void propose(std::set<proposal_t>&& proposal);
+  /**
+   * Proposes a set of values in the next lattice agreement instance. Does not block.
+   * @param proposal Values to propose
+   * @param on_decide Invoked with the decided set once the instance has decided. Callbacks run on the 
+   *   lattice agreement processor thread, in instance order, and should not block.
+   * @return The lattice agreement instance of the proposal
+   */
+  prop_nb_t propose(std::set<proposal_t>&& proposal, DecisionCallback on_decide = nullptr);
+
+  /**
+   * Proposes a set of values in the next lattice agreement instance.
+   * @return A future holding the decided set (broken promise if the node is terminated first)
+   */
+  std::future<std::set<proposal_t>> proposeAsync(std::set<proposal_t>&& proposal);
+
+  /**
+   * Proposes each set of values in consecutive lattice agreement instances.
+   * @param on_decide Invoked with the decided set of each instance (see propose)
+   * @return The lattice agreement instance of the first proposal
+   */
+  prop_nb_t proposeMany(std::vector<std::set<proposal_t>>&& proposals, DecisionCallback on_decide = nullptr);
+
+  /**
+   * Proposes each proposal of the arena in consecutive lattice agreement instances. The sets are built when
+   * each proposal is taken by the proposer thread, so the caller only hands the arena over.
+   * @return The lattice agreement instance of the first proposal
+   */
+  prop_nb_t proposeMany(std::shared_ptr<const ProposalArena> arena, DecisionCallback on_decide = nullptr);
+
+  /**
+   * Backpressure for proposal producers: blocks until fewer than PROPOSAL_QUEUE_LIMIT proposals wait to be proposed
+   * @return false if the timeout expired first
+   */
+  bool waitForProposalCapacity(std::chrono::milliseconds timeout);
+
+  /**
+   * Lattice agreement worker statistics
+   */
+  struct WorkerStats {
+    size_t queue_depth;   // messages waiting to be processed
+    uint64_t processed;   // messages processed since start
+    double utilisation;   // fraction of time spent processing messages since start
+  };
+  std::vector<WorkerStats> workerStats() const;
+  void displayWorkerStats() const;
+
+  /**
+   * Dumps all counters and gauges (node, links, lattice agreement, workers) to a file, one `<name> <value>` line each.
+   * The file is replaced atomically, so readers never see a partial dump.
+   * @param path Metrics file
+   */
+  void writeMetrics(const std::string& path);
+
+  /**
+   * Records the datagrams received by the listeners and sent by the links, and the proposals, from now on
+   * (see TraceWriter). Call before start(); the trace is flushed by cleanup().
+   */
+  void traceTo(std::unique_ptr<TraceWriter> writer);
+
+  /**
+   * Pins the threads started by start() to the CPUs of their role (see CpuAffinity). Call before start().
+   */
+  void pinThreads(const CpuAffinity& placement) { affinity = placement; }
+  const LAMetrics& latticeAgreementMetrics() const { return lattice_agreement.metrics; }
+
+  /*
+   * Single-threaded driving, used instead of start() by simulations: 
+   * the caller runs the sender, listener and proposal loops one step at a time.
+   */
+
+  /**
+   * One round of the sender loop: sends the pending packets of every link whose pacing allows it.
+   */
+  void sendPending();
+
+  /**
+   * Processes a received datagram as the listener does, then its messages as the workers do.
+   * @param data Datagram received
+   * @param len Size of the datagram
+   * @param sender Address of the sender
+   */
+  void receiveDatagram(const char *data, size_t len, const sockaddr_in &sender);
+
+  /**
+   * One step of the proposal loop: completes the current proposal if it has decided (invoking its callback) 
+   * and proposes the next queued ones until one is undecided.
+   */
+  void stepProposals();
 
 private:
   /**
@@ -79,14 +182,41 @@ private:
   void sendTo(std::shared_ptr<Message> msg, std::string dest);
 
   /**
-   * Packet sending loop that continuously sends messages to the specified destination address while the run flag is set.
+   * Packet sending loop that continuously sends the messages of the links owned by this sender thread while the run flag is set.
+   * @param sender Index of the sender thread
    */
-  void send();
+  void send(size_t sender);
 
   /**
-   * Packet listening loop that continuously listens for incoming messages and processes them while the run flag is set.
+   * Reassigns the links to the sender threads so that their backlogs are balanced.
    */
-  void listen();
+  void rebalanceSenders();
+
+  /**
+   * Packet listening loop that continuously listens for incoming packets while the run flag is set.
+   * Delivered messages are dispatched to the lattice agreement workers.
+   * @param queue Receive queue of the transport drained by this listener. Every sender maps to one queue, so the 
+   *   receive state of a link (its delivered set) is only touched by one listener.
+   */
+  void listen(size_t queue);
+
+  /**
+   * Decodes a datagram, passes it through its perfect link and hands the newly delivered messages over 
+   * to the workers, or processes them on the calling thread.
+   */
+  void handleDatagram(const char *data, size_t len, const sockaddr_in &sender_addr, bool process_inline);
+
+  /**
+   * Hands a delivered message over to the worker owning its lattice agreement instance.
+   * All messages of one instance go to the same worker, which preserves their order.
+   */
+  void dispatch(std::shared_ptr<const Message> msg, const std::string& sender_ip_and_port);
+
+  /**
+   * Lattice agreement worker loop that processes the messages dispatched to it while the run flag is set.
+   * @param worker Index of the worker
+   */
+  void processMessages(size_t worker);
 
   /**
    * Logger thread function that periodically writes log entries to the log file while the run flag is set.
@@ -102,27 +232,63 @@ private:
 
 private:
   proc_id_t id;
+  Tunables tunables;
+  Clock clock;
   std::unique_ptr<Logger> logger;
   std::atomic_bool runFlag;
 
-  int node_socket;
+  std::unique_ptr<Transport> transport;
   sockaddr_in node_addr;
+  std::unique_ptr<TraceWriter> trace;
   
   size_t nb_nodes;
   std::unordered_map<std::string, proc_id_t> others_id;
   std::unordered_map<std::string, std::unique_ptr<PerfectLink>> links;
 
+  // Sender partitioning: link_owner[i] is the sender thread owning send_links[i]
+  std::vector<PerfectLink *> send_links;
+  std::vector<std::atomic<uint32_t>> link_owner;
+  size_t nb_senders;
+
+  NodeMetrics metrics;
+
   // Primitive implementations
   friend class LatticeAgreement; // Allow instances of LatticeAgreement to access attributes of Node
   friend class LatticeAgreementInstance;
   LatticeAgreement lattice_agreement;
 
+  // Proposals are numbered and enqueued under propose_mutex so that the queue stays in instance order
+  Mutex propose_mutex{"Node::propose"};
   prop_nb_t next_la_instance_nb = 0;
-  ConcurrentDeque<std::pair<prop_nb_t, std::set<proposal_t>>> proposal_queue;
+  ConcurrentDeque<Proposal> proposal_queue;
+
+  // Single-threaded driving state (see stepProposals and sendPending)
+  std::optional<Proposal> current_proposal;
+  std::unique_ptr<SendBatch> step_batch;
+
+  // Lattice agreement workers
+  struct Worker {
+    ConcurrentDeque<std::pair<std::shared_ptr<const Message>, std::string>> queue;
+    std::atomic<uint64_t> processed{0};
+    std::atomic<uint64_t> busy_ns{0};
+    std::thread thread;
+  };
+  std::vector<std::unique_ptr<Worker>> la_workers;
+  std::chrono::steady_clock::time_point start_time;
+
+  // Listeners, one per receive queue of the transport
+  struct Listener {
+    Counter recv_calls;
+    std::thread thread;
+  };
+  std::vector<std::unique_ptr<Listener>> listeners;
+
+  // Pins a thread just started, reporting placements refused by the kernel
+  void place(std::thread& thread, CpuAffinity::Role role, size_t index);
 
   // Worker threads
-  std::thread sender_thread;
-  std::thread listener_thread;
+  CpuAffinity affinity;
+  std::vector<std::thread> sender_threads;
   std::thread logger_thread;
   std::thread lattice_agreement_processor_thread;
 };
\ No newline at end of file
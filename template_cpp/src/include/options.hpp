@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+
+#include "affinity.hpp"
+#include "tunables.hpp"
+
+/**
+ * Optional runtime settings, passed after the positional arguments of da_proc:
+ *   da_proc --id ID --hosts HOSTS --output OUTPUT CONFIG [--transport udp|shm] [--listeners N] [--steering hash|source]
+ *           [--rcvbuf BYTES] [--sndbuf BYTES] [--offload on|off] [--io sockets|uring]
+ *           [--trace PATH] [--tuning FILE] [--tune NAME=VALUE]... [--cpus ROLE=LIST]... [--busy-poll US]
+ * --tuning and --tune apply in order, so a --tune after --tuning overrides the file.
+ */
+struct RuntimeOptions {
+  enum class TransportKind { UDP, SHM };
+  enum class Steering { HASH, SOURCE };
+  enum class IoEngine { SOCKETS, URING };
+
+  TransportKind transport = TransportKind::UDP;  // shm: shared-memory rings between processes of the same host
+  size_t listeners = 1;                          // udp: SO_REUSEPORT sockets on the node's port, one listener thread each
+  Steering steering = Steering::SOURCE;          // udp: spread of the senders over the sockets (BPF by source, or kernel hash)
+  int receive_buffer = 0;                        // SO_RCVBUF of the UDP sockets in bytes, 0 for the kernel default
+  int send_buffer = 0;                           // SO_SNDBUF of the UDP sockets in bytes, 0 for the kernel default
+  bool offload = true;                           // UDP segmentation (GSO) and receive coalescing (GRO) when supported
+  IoEngine io = IoEngine::SOCKETS;               // udp: system calls per operation, or io_uring (sockets if unavailable)
+  std::string trace;                             // binary trace of the traffic and proposals (see TraceWriter), none if empty
+  Tunables tunables;                             // protocol parameters (see Tunables)
+  CpuAffinity affinity;                          // CPUs of each thread role (see CpuAffinity), unpinned by default
+  int busy_poll_us = 0;                          // udp: SO_BUSY_POLL with spinning listeners, 0 for blocking receives
+
+  /**
+   * Parses argv[first..argc)
+   * @throws std::invalid_argument on unknown options or values
+   */
+  static RuntimeOptions parse(int argc, char const *const *argv, int first);
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+/**
+ * USDT tracepoints of the protocol hot paths, provider `da` (list them with `bpftrace -l 'usdt:./da_proc:da:*'`).
+ * A probe is a nop instruction plus an ELF note locating its arguments, so an untraced probe costs nothing.
+ *
+ * Compiled in when the build defines DA_USDT, which is the default when CMake finds <sys/sdt.h> (systemtap-sdt-dev);
+ * otherwise they expand to nothing. The systemtap header and macros are exempt from the project's warning flags.
+ *
+ *   packet_sent(peer, first_seq, nb_msgs, nb_retransmitted)     PerfectLink, every MES packet added to a send batch
+ *   packet_retransmitted(peer, first_seq, nb_retransmitted)     same, when it carries messages sent before
+ *   packet_acked(peer, first_seq, nb_acked)                     PerfectLink, ACK removing pending messages
+ *   packet_received(peer, type, first_seq, nb_msgs)             Node, every decoded packet
+ *   message_duplicate(peer, seq, instance, round)               Node, message already delivered
+ *   instance_propose(instance, round, nb_values)                LatticeAgreementInstance, own proposal
+ *   instance_round(instance, round, nb_values)                  LatticeAgreementInstance, new round after a NACK
+ *   instance_decide(instance, round, nb_values)                 LatticeAgreementInstance, decision
+ */
+#if defined(DA_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Wconversion"
+#include <sys/sdt.h>
+#pragma GCC diagnostic pop
+#define DA_USDT_ENABLED
+#endif
+#endif
+
+#ifdef DA_USDT_ENABLED
+// The argument descriptors of the systemtap macros use C casts and GNU typeof
+#define DA_PROBE_DIAGNOSTICS_OFF \
+  _Pragma("GCC diagnostic push") \
+  _Pragma("GCC diagnostic ignored \"-Wold-style-cast\"") \
+  _Pragma("GCC diagnostic ignored \"-Wpedantic\"") \
+  _Pragma("GCC diagnostic ignored \"-Wconversion\"")
+#define DA_PROBE_DIAGNOSTICS_ON _Pragma("GCC diagnostic pop")
+
+#define DA_PROBE3(name, a1, a2, a3) \
+  do { DA_PROBE_DIAGNOSTICS_OFF STAP_PROBE3(da, name, a1, a2, a3); DA_PROBE_DIAGNOSTICS_ON } while (0)
+#define DA_PROBE4(name, a1, a2, a3, a4) \
+  do { DA_PROBE_DIAGNOSTICS_OFF STAP_PROBE4(da, name, a1, a2, a3, a4); DA_PROBE_DIAGNOSTICS_ON } while (0)
+#else
+#define DA_PROBE3(name, a1, a2, a3) do {} while (0)
+#define DA_PROBE4(name, a1, a2, a3, a4) do {} while (0)
+#endif
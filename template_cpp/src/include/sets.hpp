@@ -9,6 +9,7 @@
 #include <cassert>
 
 #include "globals.hpp"
+#include "lock_profile.hpp"
 #include "deque.hpp"
 #include "message.hpp"
 
@@ -54,7 +55,7 @@ private:
   bool bounded_;
   size_t maxSize_;
   std::set<T, Compare> set_;
-  mutable std::mutex mutex_;
+  mutable Mutex mutex_{"ConcurrentSet"};
 };
 
 // Sliding set that continuously trims the starting consecutive elements to avoid unbounded growth
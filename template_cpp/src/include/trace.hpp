@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "globals.hpp"
+#include "lock_profile.hpp"
+#include "message.hpp"
+#include "parser.hpp"
+
+/**
+ * Binary trace of a node's traffic, replayed offline by bench/replay.
+ *
+ * File layout (native byte order): a TraceHeader, one TraceHost per process, then the records, each a TraceRecord
+ * followed by `len` bytes: the datagram as received or sent, or the proposed values (proposal_t each).
+ */
+enum class TraceKind : uint8_t { RECEIVED, SENT, PROPOSED };
+
+struct TraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t id;          // traced process
+  uint32_t ds;
+  uint32_t nb_hosts;
+};
+
+struct TraceHost {
+  uint32_t id;
+  uint32_t ip;          // network byte order, as Parser::Host
+  uint16_t port;        // network byte order
+  uint16_t pad;
+};
+
+struct TraceRecord {
+  uint64_t time_ns;     // since the trace was opened
+  uint32_t len;
+  uint16_t peer;        // sender or destination, 0 for proposals and unknown senders
+  TraceKind kind;
+  uint8_t pad;
+};
+
+class TraceWriter {
+public:
+  static constexpr char magic[8] = {'D', 'A', 'T', 'R', 'A', 'C', 'E', '\0'};
+  static constexpr uint32_t version = 1;
+
+  /**
+   * @throws std::runtime_error if the file cannot be created
+   */
+  TraceWriter(const std::string &path, const std::vector<Parser::Host> &hosts, proc_id_t id, uint32_t ds);
+  ~TraceWriter();
+
+  // Thread safe; records are buffered and written every TRACE_BUFFER_BYTES
+  void record(TraceKind kind, proc_id_t peer, const char *data, size_t len);
+  void record(TraceKind kind, proc_id_t peer, const Packet &packet);
+  void record(const std::set<proposal_t> &proposal);
+  void record(const proposal_t *values, size_t count);
+
+  /**
+   * Writes the buffered records to the file.
+   */
+  void flush();
+
+private:
+  // Appends a record header and reserves len bytes for its payload, called with the mutex held
+  char *append(TraceKind kind, proc_id_t peer, size_t len);
+  void flushLocked();
+
+private:
+  int fd = -1;
+  std::chrono::steady_clock::time_point start;
+  Mutex mutex{"TraceWriter"};
+  std::vector<char> buffer;
+};
+
+class TraceReader {
+public:
+  /**
+   * Reads the header and the hosts of the trace
+   * @throws std::runtime_error if the file cannot be opened or is not a trace
+   */
+  explicit TraceReader(const std::string &path);
+
+  /**
+   * Reads the next record and its payload
+   * @return false at the end of the trace
+   * @throws std::runtime_error if the record is corrupt (unknown kind, or longer than max_record_len)
+   */
+  bool next(TraceRecord &record, std::vector<char> &data);
+
+  static constexpr uint32_t max_record_len = 1 << 16;   // larger than any datagram or proposal
+
+  proc_id_t id() const { return header.id; }
+  uint32_t ds() const { return header.ds; }
+  const std::vector<Parser::Host> &hosts() const { return hosts_; }
+
+private:
+  std::ifstream in;
+  TraceHeader header{};
+  std::vector<Parser::Host> hosts_;
+};
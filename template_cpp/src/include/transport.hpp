@@ -0,0 +1,321 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "globals.hpp"
+#include "parser.hpp"
+#include "metrics.hpp"
+
+/**
+ * Datagram to send: data is only borrowed for the duration of the send call
+ */
+struct Datagram {
+  const char *data;
+  size_t len;
+  sockaddr_in dest;
+};
+
+/**
+ * Datagram transport used by a node and its perfect links.
+ * send may be called concurrently (sender threads and the listeners sending ACKs). Each receive queue is drained 
+ * by a single listener thread, and all the datagrams of a sender arrive on the same queue.
+ */
+class Transport {
+public:
+  virtual ~Transport() = default;
+
+  /**
+   * Sends datagrams on a best effort basis (failed datagrams are retransmitted by the perfect links).
+   */
+  virtual void send(const Datagram *datagrams, size_t count) = 0;
+
+  /**
+   * Blocks until a datagram is received on the queue.
+   * @param queue Receive queue, below receiveQueues()
+   * @return Datagram size, 0 once the transport is shut down, -1 on error
+   */
+  virtual ssize_t receive(size_t queue, char *buffer, size_t size, sockaddr_in &sender) = 0;
+
+  /**
+   * Number of receive queues, each drained by its own listener thread
+   */
+  virtual size_t receiveQueues() const { return 1; }
+
+  /**
+   * Datagrams dropped on reception because a receive queue was full (since the transport was created)
+   */
+  virtual uint64_t receiveDrops() const { return 0; }
+
+  /**
+   * Occupancy of the fullest receive queue, as a fraction of its capacity
+   */
+  virtual double receiveQueueFill() const { return 0.0; }
+
+  /**
+   * Writes the transport's own counters, one `transport.<name> <value>` line each
+   */
+  virtual void writeMetrics(std::ostream &) const {}
+
+  /**
+   * Unblocks receive, which returns 0 from then on. Sends are dropped.
+   */
+  virtual void shutdown() = 0;
+
+  /**
+   * Releases the transport resources (after shutdown, once no thread uses the transport).
+   */
+  virtual void close() = 0;
+};
+
+/**
+ * Settings of the UDP sockets
+ */
+struct UdpConfig {
+  size_t sockets = 1;             // SO_REUSEPORT sockets on the node's port
+  bool steer_by_source = false;   // steer the senders over the sockets by address (otherwise by kernel hash)
+  int receive_buffer = 0;         // SO_RCVBUF in bytes, 0 for the kernel default
+  int send_buffer = 0;            // SO_SNDBUF in bytes, 0 for the kernel default
+  bool offload = true;            // UDP_SEGMENT sends and UDP_GRO receives where the kernel supports them
+  int busy_poll_us = 0;           // SO_BUSY_POLL and non-blocking spin receives, 0 for blocking receives
+};
+
+/**
+ * UDP sockets bound to the node's address. Several sockets share the port with SO_REUSEPORT, one receive queue each:
+ * the kernel spreads the senders over them by hashing their address, or with steer_by_source by a classic BPF 
+ * program computing steeringQueue, so that the partition of the peers is known.
+ * Kernel drops are read from the SO_RXQ_OVFL counter delivered with every datagram.
+ *
+ * With offload, consecutive datagrams to the same destination are sent as one UDP_SEGMENT buffer, each padded to 
+ * the largest of them (packets are self-delimiting, so receivers ignore the padding), and UDP_GRO receives are 
+ * split back into datagrams. Each falls back to plain datagrams when the kernel or the device refuses it.
+ *
+ * With busy_poll_us, the sockets busy poll the device queue (SO_BUSY_POLL) and receive spins on non-blocking reads,
+ * blocking only after BUSY_POLL_SPIN_US without a datagram; for nodes with a dedicated core per listener.
+ * Receives block as usual when the kernel refuses the option (it needs CAP_NET_ADMIN above net.core.busy_read).
+ */
+class UdpTransport : public Transport {
+public:
+  explicit UdpTransport(const sockaddr_in &addr, UdpConfig config = {});
+  ~UdpTransport() override;
+
+  void send(const Datagram *datagrams, size_t count) override;
+  ssize_t receive(size_t queue, char *buffer, size_t size, sockaddr_in &sender) override;
+  size_t receiveQueues() const override { return sockets.size(); }
+  uint64_t receiveDrops() const override;
+  double receiveQueueFill() const override;
+  void writeMetrics(std::ostream &os) const override;
+  void shutdown() override;
+  void close() override;
+
+  /**
+   * Non-blocking receive on the first queue
+   * @return Datagram size, or -1 if no datagram is queued
+   */
+  ssize_t tryReceive(char *buffer, size_t size, sockaddr_in &sender);
+
+  /**
+   * Receive queue of the datagrams of a sender when steering by source
+   */
+  static size_t steeringQueue(const sockaddr_in &sender, size_t nb_queues);
+
+protected:
+  /*
+   * System calls of the transport, replaced by other I/O engines (see UringTransport)
+   */
+
+  /**
+   * Receives one message from the socket of a queue (the whole buffer when coalesced), recording its drop counter.
+   * @param flags MSG_DONTWAIT to return -1 (EAGAIN) instead of blocking
+   * @param segment Set to the segment size of a coalesced buffer (left unchanged otherwise)
+   * @return Message size, 0 once shut down, -1 on error
+   */
+  virtual ssize_t receiveMessage(size_t queue, char *buffer, size_t size, sockaddr_in &sender, int flags, size_t &segment);
+
+  /**
+   * Sends the messages from the first socket.
+   * @param errors Set to 0 for every message sent, to the errno of its failure otherwise
+   */
+  virtual void sendMessages(mmsghdr *msgs, size_t count, int *errors);
+
+  // Records the SO_RXQ_OVFL and UDP_GRO control messages of a received message
+  void readControl(size_t queue, msghdr &msg, size_t &segment);
+  static constexpr size_t receive_control_size = CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(int));
+
+private:
+  // Attaches the steering program to the reuseport group of a socket, returns false if the kernel refuses it
+  static bool attachSteering(int socket_fd, size_t nb_sockets);
+
+  // Spins on non-blocking receives for up to BUSY_POLL_SPIN_US, then blocks
+  ssize_t spinReceive(size_t queue, char *buffer, size_t size, sockaddr_in &sender);
+
+  // Receives the next datagram of a queue, from its pending coalesced buffer first
+  ssize_t receiveFrom(size_t queue, char *buffer, size_t size, sockaddr_in &sender, int flags);
+
+  // Sends runs of datagrams, each as a single segmented buffer if it holds more than one datagram
+  void sendRuns(const Datagram *datagrams, const std::array<std::pair<size_t, size_t>, SEND_BATCH_SIZE> &runs, size_t nb_runs);
+
+protected:
+  std::vector<int> sockets;                 // sockets[0] also sends
+  std::vector<std::atomic<uint32_t>> drops; // last SO_RXQ_OVFL counter of each socket
+
+private:
+
+  // Offload
+  std::atomic_bool segmentation{false};
+  bool gro = false;
+  struct Coalesced {                        // GRO buffer being split, per receive queue
+    std::vector<char> data;
+    size_t offset = 0;
+    size_t len = 0;
+    size_t segment = 0;
+    sockaddr_in sender{};
+  };
+  std::vector<Coalesced> coalesced;
+
+  bool busy_poll = false;
+  Counter spin_blocks;                      // busy-poll receives that blocked after spinning
+
+  Counter segmented_sends;
+  Counter segmented_datagrams;
+  Counter coalesced_receives;
+  Counter coalesced_datagrams;
+};
+
+/**
+ * Shared-memory transport for processes of the same host, UDP for the others.
+ * Every process maps one region holding its doorbell (a futex word) and one single-producer single-consumer 
+ * ring per peer. Senders open the regions of their local peers lazily and push datagrams into their own ring,
+ * falling back to UDP until the region exists. A full ring drops the datagram, as a full socket buffer does: 
+ * the perfect links retransmit it. Datagrams larger than the receive buffer are dropped too (both count as
+ * receive drops).
+ */
+class ShmTransport : public Transport {
+public:
+  ShmTransport(const std::vector<Parser::Host> &hosts, unsigned long id, UdpConfig udp_config = {});
+  ~ShmTransport() override;
+
+  void send(const Datagram *datagrams, size_t count) override;
+  ssize_t receive(size_t queue, char *buffer, size_t size, sockaddr_in &sender) override;
+  uint64_t receiveDrops() const override;
+  double receiveQueueFill() const override;
+  void writeMetrics(std::ostream &os) const override;
+  void shutdown() override;
+  void close() override;
+
+  struct Region;
+
+private:
+  struct Peer {
+    bool local;
+    sockaddr_in addr;
+    std::string name;                       // name of the peer's region
+    std::mutex mutex;                       // serializes the local producers of the ring
+    Region *region = nullptr;
+    std::chrono::steady_clock::time_point next_attempt{};
+  };
+
+  // Maps the peer's region if it exists (retried every SHM_OPEN_RETRY_MS), called with the peer's mutex held
+  Region *openPeer(Peer &peer);
+
+private:
+  UdpTransport udp;
+  size_t self;                              // index of this process (id - 1)
+  std::vector<std::unique_ptr<Peer>> peers; // by index
+  std::unordered_map<std::string, size_t> peer_index;
+  bool has_remote = false;
+
+  std::string name;
+  size_t region_size;
+  Region *inbound = nullptr;
+  size_t next_ring = 0;
+  std::atomic_bool shut_down{false};
+};
+
+/**
+ * Conditions of an in-memory network. Delays are drawn uniformly in [delay, delay + jitter], 
+ * so a jitter larger than the interval between two datagrams reorders them.
+ */
+struct NetworkConditions {
+  double loss = 0.0;                       // probability that a datagram is dropped
+  std::chrono::microseconds delay{0};
+  std::chrono::microseconds jitter{0};
+  size_t inbox_capacity = 1024;            // datagrams queued per node before new ones are dropped (as a full socket buffer)
+  uint32_t seed = 1;
+};
+
+class InMemoryTransport;
+
+/**
+ * Network connecting the in-memory transports of the nodes of one process, by address
+ */
+class InMemoryNetwork : public std::enable_shared_from_this<InMemoryNetwork> {
+public:
+  explicit InMemoryNetwork(NetworkConditions conditions = {});
+
+  /**
+   * Creates the transport of the node listening on addr
+   */
+  std::unique_ptr<InMemoryTransport> attach(const sockaddr_in &addr);
+
+private:
+  friend class InMemoryTransport;
+
+  // Applies the loss and delay model and hands the datagram over to its destination (if attached)
+  void deliver(const sockaddr_in &from, const Datagram &datagram);
+  void detach(const sockaddr_in &addr);
+
+private:
+  NetworkConditions conditions;
+  std::mutex mutex;
+  std::mt19937 rng;
+  std::unordered_map<std::string, InMemoryTransport *> endpoints;
+};
+
+class InMemoryTransport : public Transport {
+public:
+  InMemoryTransport(std::shared_ptr<InMemoryNetwork> network, const sockaddr_in &addr);
+  ~InMemoryTransport() override;
+
+  void send(const Datagram *datagrams, size_t count) override;
+  ssize_t receive(size_t queue, char *buffer, size_t size, sockaddr_in &sender) override;
+  uint64_t receiveDrops() const override { return dropped.load(std::memory_order_relaxed); }
+  void shutdown() override;
+  void close() override;
+
+private:
+  friend class InMemoryNetwork;
+
+  struct InFlight {
+    std::chrono::steady_clock::time_point deliver_at;
+    sockaddr_in from;
+    std::vector<char> data;
+  };
+
+  void enqueue(InFlight &&datagram, size_t capacity);
+
+private:
+  std::shared_ptr<InMemoryNetwork> network;
+  sockaddr_in addr;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::multimap<std::chrono::steady_clock::time_point, InFlight> inbox;  // by delivery time, ties in send order
+  bool shut_down = false;
+  std::atomic<uint64_t> dropped{0};   // full inbox
+};
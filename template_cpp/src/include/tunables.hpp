@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "globals.hpp"
+
+/**
+ * Protocol parameters settable at startup, defaulting to the constants of globals.hpp.
+ * Set one with `--tune NAME=VALUE` or a tuning file (`--tuning FILE`), one `NAME VALUE` or `NAME=VALUE` per line,
+ * `#` starting a comment:
+ *   send_window            packets sent per link and sender round (1 to MAX_SEND_WINDOW_SIZE)
+ *   messages_per_packet    messages per MES packet (1 to MAX_MESSAGES_PER_PACKET)
+ *   send_timeout_ms        minimum pause between sender rounds
+ *   log_timeout_ms         period of the decision log flush
+ *   broadcast_cooldown_ms  pause after each broadcast of a proposal
+ */
+struct Tunables {
+  uint32_t send_window = SEND_WINDOW_SIZE;
+  uint32_t messages_per_packet = MESSAGES_PER_PACKET;
+  uint32_t send_timeout_ms = SEND_TIMEOUT_MS;
+  uint32_t log_timeout_ms = LOG_TIMEOUT;
+  uint32_t broadcast_cooldown_ms = BROADCAST_COOLDOWN_MS;
+
+  /**
+   * Sets a parameter by name
+   * @throws std::invalid_argument on unknown names or values out of range
+   */
+  void set(const std::string &name, const std::string &value);
+
+  /**
+   * Value of a parameter by name
+   * @throws std::invalid_argument on unknown names
+   */
+  uint32_t get(const std::string &name) const;
+
+  /**
+   * Sets a parameter from NAME=VALUE
+   * @throws std::invalid_argument if malformed, see set
+   */
+  void assign(const std::string &assignment);
+
+  /**
+   * Reads a tuning file, parameters it does not mention keep their value
+   * @throws std::invalid_argument if the file cannot be read or a line is invalid
+   */
+  void load(const std::string &path);
+
+  /**
+   * Writes every parameter in the tuning file format
+   */
+  void write(std::ostream &os) const;
+
+  static std::vector<std::string> names();
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include <ctime>
+#include <linux/io_uring.h>
+
+#include "globals.hpp"
+#include "metrics.hpp"
+#include "transport.hpp"
+
+/**
+ * Minimal io_uring instance over the raw system calls: one submission and one completion queue,
+ * used by a single thread at a time.
+ */
+class IoUring {
+public:
+  /**
+   * @param entries Submission queue size (rounded up to a power of two by the kernel)
+   * @throws std::runtime_error if the kernel does not provide io_uring
+   */
+  explicit IoUring(unsigned entries);
+  ~IoUring();
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  /**
+   * Next free submission entry (zeroed), queued by the next submitAndWait
+   * @return nullptr if the submission queue is full
+   */
+  io_uring_sqe *getSqe();
+
+  /**
+   * Submits the queued entries and waits for wait_nr completions, for at most timeout if given.
+   * Entries left over by a previous partial submission are submitted again.
+   * @return The number of entries submitted, or -errno (-ETIME once the timeout expired)
+   */
+  int submitAndWait(unsigned wait_nr, const timespec *timeout = nullptr);
+
+  /**
+   * Oldest unseen completion, nullptr if there is none. cqeSeen releases it.
+   */
+  io_uring_cqe *peekCqe();
+  void cqeSeen();
+
+private:
+  int ring_fd = -1;
+  io_uring_params params{};
+
+  void *sq_ring = nullptr;
+  size_t sq_ring_size = 0;
+  void *cq_ring = nullptr;
+  size_t cq_ring_size = 0;
+  io_uring_sqe *sqes = nullptr;
+  size_t sqes_size = 0;
+
+  // Submission queue (sqe_tail is ahead of the shared tail by the entries not published yet, the shared tail ahead 
+  // of the head by the entries published but not consumed by the kernel yet)
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned sqe_tail = 0;
+
+  // Completion queue
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  io_uring_cqe *cqes;
+};
+
+/**
+ * UDP transport driven by io_uring instead of blocking system calls.
+ * Every receive queue keeps a multishot recvmsg outstanding over a pool of buffers provided to its ring (the kernel
+ * picks a free one per datagram and the listener hands it back once copied out), and its listener reaps the
+ * completions. The datagrams of a send call are submitted together, in a single io_uring_enter that also waits
+ * for their completions.
+ * Socket setup, steering, offload and drop accounting are those of UdpTransport.
+ */
+class UringTransport : public UdpTransport {
+public:
+  /**
+   * Needs Linux 6.0 (multishot recvmsg)
+   * @throws std::runtime_error if the kernel does not provide io_uring or rejects the multishot receive
+   */
+  explicit UringTransport(const sockaddr_in &addr, UdpConfig config = {});
+  ~UringTransport() override;
+
+  void writeMetrics(std::ostream &os) const override;
+  void shutdown() override;
+  void close() override;
+
+protected:
+  ssize_t receiveMessage(size_t queue, char *buffer, size_t size, sockaddr_in &sender, int flags, size_t &segment) override;
+  void sendMessages(mmsghdr *msgs, size_t count, int *errors) override;
+
+private:
+  // Receive side of a queue, used by its listener thread only
+  struct Receiver {
+    std::unique_ptr<IoUring> ring;
+    std::vector<char> buffers;            // URING_RECV_BUFFERS buffers of buffer_size bytes
+    msghdr layout{};                      // name and control sizes of the multishot receive
+    size_t unsubmitted = 0;               // buffers handed back but not submitted yet
+    bool armed = false;
+  };
+
+  // (Re)submits the multishot receive of a queue
+  void arm(size_t queue);
+
+  // Gives a consumed buffer back to the kernel (submitted in batches, or with the next wait)
+  void recycle(Receiver &receiver, uint16_t id);
+
+private:
+  // user_data of the receive and of the buffer hand-backs
+  static constexpr __u64 receive_tag = 0;
+  static constexpr __u64 provide_tag = 1;
+
+  size_t buffer_size;
+  std::vector<std::unique_ptr<Receiver>> receivers;
+
+  std::mutex send_mutex;                  // senders and listeners (ACKs) share the send ring
+  std::unique_ptr<IoUring> send_ring;
+  bool send_ring_broken = false;          // sends fell back to sendmmsg
+
+  std::atomic_bool shut_down{false};
+  Counter send_submissions;
+  Counter rearms;
+};
@@ -0,0 +1,90 @@
+#include "affinity.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+
+namespace {
+
+constexpr CpuAffinity::Role roles[] = {
+  CpuAffinity::Role::SENDER, CpuAffinity::Role::LISTENER, CpuAffinity::Role::WORKER,
+  CpuAffinity::Role::PROPOSER, CpuAffinity::Role::LOGGER,
+};
+constexpr const char *role_names[] = {"sender", "listener", "worker", "proposer", "logger"}; // in Role order
+
+int parseCpu(const std::string &value, const std::string &list)
+{
+  unsigned long cpu = 0;
+  size_t end = 0;
+  try {
+    cpu = std::stoul(value, &end);
+  } catch (const std::exception&) {
+    end = 0;
+  }
+  if (end == 0 || end != value.size() || value[0] == '-' || cpu >= CPU_SETSIZE) {
+    throw std::invalid_argument("Invalid CPU list " + list);
+  }
+  return static_cast<int>(cpu);
+}
+
+} // namespace
+
+const char *CpuAffinity::name(Role role)
+{
+  return role_names[static_cast<size_t>(role)];
+}
+
+void CpuAffinity::assign(const std::string &assignment)
+{
+  size_t equal = assignment.find('=');
+  if (equal == std::string::npos) throw std::invalid_argument("Expected ROLE=CPUS, got " + assignment);
+  std::string role_name = assignment.substr(0, equal);
+  std::string list = assignment.substr(equal + 1);
+
+  const Role *role = nullptr;
+  for (const Role &r: roles) {
+    if (role_name == name(r)) role = &r;
+  }
+  if (role == nullptr) {
+    throw std::invalid_argument("Unknown thread role " + role_name + " (expected sender, listener, worker, proposer or logger)");
+  }
+
+  std::vector<int> parsed;
+  size_t begin = 0;
+  while (begin <= list.size()) {
+    size_t comma = list.find(',', begin);
+    std::string item = list.substr(begin, comma == std::string::npos ? std::string::npos : comma - begin);
+    size_t dash = item.find('-');
+    if (dash == std::string::npos) {
+      parsed.push_back(parseCpu(item, list));
+    }
+    else {
+      int first = parseCpu(item.substr(0, dash), list);
+      int last = parseCpu(item.substr(dash + 1), list);
+      if (last < first) throw std::invalid_argument("Invalid CPU list " + list);
+      for (int cpu = first; cpu <= last; cpu++) parsed.push_back(cpu);
+    }
+    if (comma == std::string::npos) break;
+    begin = comma + 1;
+  }
+  cpus[static_cast<size_t>(*role)] = std::move(parsed);
+}
+
+bool CpuAffinity::empty() const
+{
+  for (const auto &list: cpus) {
+    if (!list.empty()) return false;
+  }
+  return true;
+}
+
+bool CpuAffinity::pin(std::thread &thread, Role role, size_t index) const
+{
+  const std::vector<int> &list = cpus[static_cast<size_t>(role)];
+  if (list.empty()) return true;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(static_cast<size_t>(list[index % list.size()]), &set);
+  return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+}
@@ -0,0 +1,112 @@
+#include "config.hpp"
+
+#include <charconv>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ===================== ProposalArena start ===================== //
+void ProposalArena::clear()
+{
+  values.clear();
+  offsets.assign(1, 0);
+}
+
+std::set<proposal_t> ProposalArena::toSet(size_t i) const
+{
+  return std::set<proposal_t>(begin(i), begin(i) + count(i));
+}
+// ===================== ProposalArena end ===================== //
+
+// ===================== ConfigReader start ===================== //
+ConfigReader::ConfigReader(const std::string &path) : path(path)
+{
+  fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::invalid_argument("`" + path + "` does not exist");
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    throw std::invalid_argument("`" + path + "` file empty or error handling file");
+  }
+  length = static_cast<size_t>(st.st_size);
+
+  void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    ::close(fd);
+    throw std::invalid_argument("`" + path + "` could not be mapped");
+  }
+  // The file is read front to back exactly once
+  madvise(mapped, length, MADV_SEQUENTIAL);
+  data = static_cast<const char*>(mapped);
+  pos = data;
+
+  // Extract lattice agreement parameters (p, vs, ds)
+  std::vector<uint32_t> header;
+  bool parsed = false;
+  try {
+    parsed = parseLine(header) && header.size() >= 3;
+  } catch (const std::invalid_argument&) {}
+  if (!parsed) {
+    munmap(mapped, length);
+    ::close(fd);
+    throw std::invalid_argument("Error parsing integers from config file");
+  }
+  shots_ = header[0];
+  vs_ = header[1];
+  ds_ = header[2];
+}
+
+ConfigReader::~ConfigReader()
+{
+  if (data != nullptr) munmap(const_cast<char*>(data), length);
+  if (fd >= 0) ::close(fd);
+}
+
+size_t ConfigReader::read(ProposalArena &arena, size_t max_shots)
+{
+  size_t count = 0;
+  std::vector<proposal_t> line;
+  while (count < max_shots && read_shots < shots_) {
+    line.clear();
+    if (!parseLine(line)) {
+      throw std::invalid_argument("`" + path + "` file empty or error handling file");
+    }
+    arena.values.insert(arena.values.end(), line.begin(), line.end());
+    arena.offsets.push_back(arena.values.size());
+    read_shots++;
+    count++;
+  }
+  return count;
+}
+
+template <typename Int>
+bool ConfigReader::parseLine(std::vector<Int> &out)
+{
+  const char *end = data + length;
+  if (pos >= end) return false;
+
+  while (pos < end && *pos != '\n') {
+    if (*pos == ' ' || *pos == '\t' || *pos == '\r') {
+      pos++;
+      continue;
+    }
+
+    Int value;
+    auto [next, ec] = std::from_chars(pos, end, value);
+    if (ec != std::errc()) {
+      throw std::invalid_argument("Error parsing integers from config file");
+    }
+    out.push_back(value);
+    pos = next;
+  }
+
+  // Skip the newline
+  if (pos < end) pos++;
+  return true;
+}
+// ===================== ConfigReader end ===================== //
@@ -1,18 +1,19 @@
 #include "deque.hpp"
+#include "lattice_agreement.hpp"
 
 // ===================== ConcurrentDeque start ===================== //
 // Capacity methods
 template <typename T>
 bool ConcurrentDeque<T>::empty() const
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return deque_.empty();
 }
 
 template <typename T>
 std::size_t ConcurrentDeque<T>::size() const
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return deque_.size();
 }
 
@@ -20,10 +21,9 @@ std::size_t ConcurrentDeque<T>::size() const
 template <typename T>
 void ConcurrentDeque<T>::push_back(const T& value)
 {
-  std::lock_guard<std::mutex> lock(mutex_);
+  MutexLock lock(mutex_);
   
   // Optional: Wait until there is space in the deque
-  // std::unique_lock<std::mutex> lock(mutex_);
   // cv_.wait(lock, [&]() {
   //   return deque_.size() < maxSize_;
   // });
@@ -31,28 +31,49 @@ void ConcurrentDeque<T>::push_back(const T& value)
   deque_.push_back(value);
   
   // Notify any waiting threads that a new element has been added
-  // lock.unlock();
-  // cv_.notify_one();
+  lock.unlock();
+  cv_.notify_one();
+}
+
+template <typename T>
+void ConcurrentDeque<T>::push_back(T&& value)
+{
+  MutexLock lock(mutex_);
+  deque_.push_back(std::move(value));
+  
+  lock.unlock();
+  cv_.notify_one();
+}
+
+template <typename T>
+void ConcurrentDeque<T>::push_back_all(std::vector<T>&& values)
+{
+  MutexLock lock(mutex_);
+  for (T& value: values) {
+    deque_.push_back(std::move(value));
+  }
+  
+  lock.unlock();
+  cv_.notify_all();
 }
 
 template <typename T>
 T ConcurrentDeque<T>::pop_front()
 {
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
   
   // Optional: Wait until deque is non-empty
-  // std::unique_lock<std::mutex> lock(mutex_);
+  // MutexLock lock(mutex_);
   // cv_.wait(lock, [&]() {
   //   return !deque_.empty();
   // });
   
   
-  T value = deque_.front();
+  T value = std::move(deque_.front());
   deque_.pop_front();
   
   // Notify waiting threads that space is available
-  // lock.unlock();
-  // cv_.notify_one();
+  space_cv_.notify_all();
   
   return value;
 }
@@ -60,8 +81,26 @@ T ConcurrentDeque<T>::pop_front()
 template <typename T>
 std::vector<T> ConcurrentDeque<T>::pop_k_front(size_t k)
 {
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
+  return pop_k_front_locked(k);
+}
 
+template <typename T>
+std::vector<T> ConcurrentDeque<T>::wait_pop_k_front(size_t k, std::chrono::milliseconds timeout)
+{
+  MutexLock lock(mutex_);
+
+  // Wait until deque is non-empty
+  cv_.wait_for(lock, timeout, [&]() {
+    return !deque_.empty();
+  });
+
+  return pop_k_front_locked(k);
+}
+
+template <typename T>
+std::vector<T> ConcurrentDeque<T>::pop_k_front_locked(size_t k)
+{
   size_t count = std::min(k, deque_.size());
 
   // advance the deque iterator by count
@@ -76,6 +115,7 @@ std::vector<T> ConcurrentDeque<T>::pop_k_front(size_t k)
 
   // Erase the moved elements from the beginning of the deque.
   deque_.erase(deque_.begin(), end);
+  if (count > 0) space_cv_.notify_all();
   
   return output;
 }
@@ -83,37 +123,47 @@ std::vector<T> ConcurrentDeque<T>::pop_k_front(size_t k)
 template <typename T>
 void ConcurrentDeque<T>::clear()
 {
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
   deque_.clear();
   
   // Notify all waiting threads
-  // cv_.notify_all();
+  space_cv_.notify_all();
+}
+
+template <typename T>
+bool ConcurrentDeque<T>::wait_size_below(size_t limit, std::chrono::milliseconds timeout)
+{
+  MutexLock lock(mutex_);
+  return space_cv_.wait_for(lock, timeout, [&]() {
+    return deque_.size() < limit;
+  });
 }
 
 // Lookup
 template <typename T>
 T ConcurrentDeque<T>::front() const
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return deque_.front();
 }
 
 template <typename T>
 T ConcurrentDeque<T>::back() const
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return deque_.back();
 }
 
 template <typename T>
 std::vector<T> ConcurrentDeque<T>::snapshot() const
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return std::vector<T>(deque_.begin(), deque_.end());
 }
 // ===================== ConcurrentDeque end ===================== //
 
 // Explicit template instantiation
 template class ConcurrentDeque<std::pair<pkt_seq_t, std::shared_ptr<Message>>>;
-template class ConcurrentDeque<std::pair<prop_nb_t, std::set<proposal_t>>>;
-template class ConcurrentDeque<std::pair<uint32_t, std::set<proc_id_t>>>;
\ No newline at end of file
+template class ConcurrentDeque<Proposal>;
+template class ConcurrentDeque<std::pair<uint32_t, std::set<proc_id_t>>>;
+template class ConcurrentDeque<std::pair<std::shared_ptr<const Message>, std::string>>;
\ No newline at end of file
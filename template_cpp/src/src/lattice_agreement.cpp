@@ -1,5 +1,40 @@
 #include "lattice_agreement.hpp"
 #include "node.hpp"
+#include "probes.hpp"
+
+/**
+ * Merge sorted values into a sorted, duplicate free vector
+ */
+static void mergeSorted(std::vector<proposal_t>& into, const std::vector<proposal_t>& values)
+{
+  std::vector<proposal_t> merged;
+  merged.reserve(into.size() + values.size());
+  std::set_union(into.begin(), into.end(), values.begin(), values.end(), std::back_inserter(merged));
+  into.swap(merged);
+}
+
+/**
+ * Acceptor step: merge a proposal into the accepted set
+ * @return Whether the proposal is acknowledged (it contains the accepted set)
+ */
+static bool accept(std::vector<proposal_t>& accepted, const Message& msg)
+{
+  bool acknowledge = std::includes(
+    msg.proposed_values.begin(), msg.proposed_values.end(),   // Set proposed by other node
+    accepted.begin(), accepted.end());                        // Local accepted set
+
+  if (acknowledge)
+  {
+    // Proposed set contains the accepted set, so it is the union of both
+    accepted = msg.proposed_values;
+  }
+  else
+  {
+    mergeSorted(accepted, msg.proposed_values);
+  }
+  return acknowledge;
+}
+
 
 // Single-shot Lattice agreement object
 LatticeAgreementInstance::LatticeAgreementInstance(size_t nb_nodes, uint32_t ds, Node *p, prop_nb_t instance_id)
@@ -9,12 +44,14 @@ LatticeAgreementInstance::LatticeAgreementInstance(size_t nb_nodes, uint32_t ds,
 bool LatticeAgreementInstance::processMessage(std::shared_ptr<const Message> msg, std::string sender_ip_and_port)
 {
   // Lock to avoid processing a message at the same time as resetting and proposing
-  std::lock_guard<std::mutex> lock(la_mutex);
+  std::lock_guard<Mutex> lock(la_mutex);
+  if (retired) return false;
   
   switch (msg->type)
   {
   // Acceptor code
   case MessageType::MES:
+  {
     // std::cout << "msg proposal set: { ";
     // for (const auto& value: msg->proposed_values)
     // {
@@ -27,30 +64,21 @@ bool LatticeAgreementInstance::processMessage(std::shared_ptr<const Message> msg
     // }
     // std::cout << "}\n";
 
-
-    if (std::includes(
-      msg->proposed_values.begin(), msg->proposed_values.end(),   // Set proposed by other node
-      accepted_values.begin(), accepted_values.end()))            // Local accepted set
-    {
-      accepted_values.insert(msg->proposed_values.begin(), msg->proposed_values.end());
-      respond(msg, sender_ip_and_port, true);
-      acknowledgements_sent++;
-    }
-    else
-    {
-      accepted_values.insert(msg->proposed_values.begin(), msg->proposed_values.end());
-      respond(msg, sender_ip_and_port, false);
-    }
+    bool acknowledge = accept(accepted_values, *msg);
+    respond(parent, *msg, sender_ip_and_port, accepted_values, acknowledge);
     break;
+  }
 
-  // Proposer code
+  // Proposer code (responses are ignored once decided)
   case MessageType::ACK:
-    if (msg->round == active_proposal_number)
+    parent->lattice_agreement.metrics.acks_received.add();
+    if (msg->round == active_proposal_number && active)
     {
+      recordFirstResponse();
       ack_count++;
 
       // Check for majority ack
-      if (ack_count > (nb_nodes-1)/2 && active)
+      if (ack_count > (nb_nodes-1)/2)
       {
         active = false;
         decide();
@@ -59,13 +87,15 @@ bool LatticeAgreementInstance::processMessage(std::shared_ptr<const Message> msg
     break;  
 
   case MessageType::NACK:
-    if (msg->round == active_proposal_number)
+    parent->lattice_agreement.metrics.nacks_received.add();
+    if (msg->round == active_proposal_number && active)
     {
+      recordFirstResponse();
       nack_count++;
       proposed_values.insert(msg->proposed_values.begin(), msg->proposed_values.end());
 
       // Check for majority response
-      if (nack_count > 0 && (ack_count + nack_count) >= nb_nodes/2 && active)
+      if (nack_count > 0 && (ack_count + nack_count) >= nb_nodes/2)
       {
         // Reset attributes
         active_proposal_number++;
@@ -75,6 +105,7 @@ bool LatticeAgreementInstance::processMessage(std::shared_ptr<const Message> msg
         // Update own proposal based on accepted_values (msg's proposal already added before)
         // Optimization to avoid sending set nacked by self
         updateProposal();
+        DA_PROBE3(instance_round, instance_id, active_proposal_number, proposed_values.size());
         // std::cout << "Proposal updated, broadcasting\n";
         broadcastProposal();
 
@@ -91,41 +122,68 @@ bool LatticeAgreementInstance::processMessage(std::shared_ptr<const Message> msg
   default:
     break;  
   }
-
-  // If instance has decided and acknowledged proposals from all other nodes, return true
-  return decided && acknowledgements_sent == nb_nodes;
+  return true;
 }
 
 void LatticeAgreementInstance::propose(std::set<proposal_t> proposal)
 {
   // Lock to avoid proposing at the same time as processing a message
-  std::lock_guard<std::mutex> lock(la_mutex);
+  std::lock_guard<Mutex> lock(la_mutex);
 
   has_proposal = true;
   active = true;
+  proposed_at = parent->clock();
   
   // Merge proposal with accepted_values to accept or reject its own proposal
   proposed_values = std::move(proposal);
   updateProposal();
+  DA_PROBE3(instance_propose, instance_id, active_proposal_number, proposed_values.size());
   
   // TODO: check if rebroadcast is  necessary (proposal contained in accepted set)
   broadcastProposal();
 }
 
-void LatticeAgreementInstance::waitUntilDecidedOrTerminated()
+std::optional<std::set<proposal_t>> LatticeAgreementInstance::waitUntilDecidedOrTerminated()
 {
-  std::unique_lock<std::mutex> lock(decision_mutex);
+  MutexLock lock(decision_mutex);
   decision_cv.wait(lock, [this]{ return decided || terminated; });
   // std::cout << "LatticeAgreementInstance " << instance_id << " exited wait\n";
+
+  if (!decided) return std::nullopt;
+  return std::move(decision);
+}
+
+std::optional<std::set<proposal_t>> LatticeAgreementInstance::pollDecision()
+{
+  std::lock_guard<Mutex> lock(decision_mutex);
+  if (!decided) return std::nullopt;
+  return std::move(decision);
 }
 
 void LatticeAgreementInstance::terminate()
 {
   // std::cout << "LatticeAgreementInstance " << instance_id << " terminated\n";
+  std::lock_guard<Mutex> lock(decision_mutex);
   terminated = true;
   decision_cv.notify_all();
 }
 
+size_t LatticeAgreementInstance::memoryFootprint()
+{
+  std::lock_guard<Mutex> lock(la_mutex);
+
+  // Each std::set node holds the value, three pointers and a color
+  size_t set_node_size = sizeof(proposal_t) + 4 * sizeof(void *);
+  return sizeof(*this) + accepted_values.capacity() * sizeof(proposal_t) + (proposed_values.size() + decision.size()) * set_node_size;
+}
+
+std::vector<proposal_t> LatticeAgreementInstance::retire()
+{
+  std::lock_guard<Mutex> lock(la_mutex);
+  retired = true;
+  return std::move(accepted_values);
+}
+
 // Private methods:
 void LatticeAgreementInstance::broadcastProposal()
 {
@@ -134,16 +192,18 @@ void LatticeAgreementInstance::broadcastProposal()
   parent->broadcast(msg_ptr);
 }
 
-void LatticeAgreementInstance::respond(std::shared_ptr<const Message> msg, std::string sender_ip_and_port, bool acknowledge)
+void LatticeAgreementInstance::respond(Node *parent, const Message& msg, const std::string& sender_ip_and_port, 
+                                       const std::vector<proposal_t>& accepted, bool acknowledge)
 {
   // Create response
-  auto response = acknowledge ? msg->toAck() : msg->toNack(accepted_values);
+  auto response = acknowledge ? msg.toAck() : msg.toNack(accepted);
+  (acknowledge ? parent->lattice_agreement.metrics.acks_sent : parent->lattice_agreement.metrics.nacks_sent).add();
   parent->sendTo(std::make_shared<Message>(std::move(response)), sender_ip_and_port);
 }
 
 void LatticeAgreementInstance::decide()
 {
-  std::lock_guard<std::mutex> lock(decision_mutex);
+  std::lock_guard<Mutex> lock(decision_mutex);
   if (decided) return;
   if (!has_proposal) return;
 
@@ -156,48 +216,71 @@ void LatticeAgreementInstance::decide()
 
   decided = true;
   active = false;
+  DA_PROBE3(instance_decide, instance_id, active_proposal_number, proposed_values.size());
   parent->logger->logDecision(proposed_values);
+  LAMetrics &metrics = parent->lattice_agreement.metrics;
+  metrics.instances_decided.add();
+  metrics.rounds.add(active_proposal_number + 1);
+  metrics.rounds_per_instance.record(active_proposal_number + 1);
+  metrics.decision_us.record(microsecondsBetween(proposed_at, parent->clock()));
+
+  // Only the acceptor state is needed from now on: hand the proposer set over to the waiter and freeze the accepted array
+  decision = std::move(proposed_values);
+  proposed_values.clear();
+  accepted_values.shrink_to_fit();
 
   decision_cv.notify_one();
 }
 
+void LatticeAgreementInstance::recordFirstResponse()
+{
+  if (responded) return;
+  responded = true;
+  parent->lattice_agreement.metrics.first_response_us.record(microsecondsBetween(proposed_at, parent->clock()));
+}
+
 void LatticeAgreementInstance::updateProposal()
 {
   proposed_values.insert(accepted_values.begin(), accepted_values.end());
 
   // Accept own proposal
-  accepted_values = proposed_values;
-  acknowledgements_sent = 1;
+  accepted_values.assign(proposed_values.begin(), proposed_values.end());
   ack_count = 1;
 }
 
 // Multi-shot Lattice agreement object
 LatticeAgreement::LatticeAgreement(size_t nb_nodes, uint32_t ds, Node *p)
-  : nb_nodes(nb_nodes), distinct_values(ds), parent(p)
-{}
+  : instances([this](const prop_nb_t& instance_id) {
+      auto instance = std::make_shared<LatticeAgreementInstance>(this->nb_nodes, this->distinct_values, this->parent, instance_id);
+      // Instances created after termination must not block their waiter
+      if (terminated.load()) instance->terminate();
+      return instance;
+    }),
+    node_progress(nb_nodes), 
+    node_last_heard(nb_nodes),
+    nb_nodes(nb_nodes), distinct_values(ds), parent(p)
+{
+  int64_t now = parent->clock().time_since_epoch().count();
+  for (auto& last_heard: node_last_heard) last_heard.store(now);
+}
 
 void LatticeAgreement::processMessage(std::shared_ptr<const Message> msg, std::string sender_ip_and_port)
 {
-  std::lock_guard<std::mutex> lock(la_manager_mutex);
-  
   // std::cout << "processing message from " << sender_ip_and_port << ": ";
   // msg.get()->displayMessage();
 
-  tryAddingInstance(msg->instance);
+  updatePeerProgress(parent->others_id.at(sender_ip_and_port), *msg);
 
-  // Process message and destroy instance if not needed anymore
-  bool destroy_instance = instances[msg->instance]->processMessage(msg, sender_ip_and_port);
-  if (destroy_instance)
-  {
-    std::cout << "Destroying LA instance " << msg->instance << ", all processes have decided for that instance\n";
-    instances.erase(msg->instance);
-  }
+  auto instance = getInstance(msg->instance);
+  if (instance && instance->processMessage(msg, sender_ip_and_port)) return;
+
+  // Instance already freed: proposals are answered from its retired acceptor state, responses are stale 
+  // (this node has decided it)
+  if (msg->type == MessageType::MES) processRetired(msg, sender_ip_and_port);
 }
 
 void LatticeAgreement::propose(prop_nb_t instance_id, std::set<proposal_t> proposal)
 {
-  std::lock_guard<std::mutex> lock(la_manager_mutex);
-
   // std::cout << "Proposing (instance " << instance_id << "): { ";
   // for (const auto& value: proposal)
   // {
@@ -205,32 +288,131 @@ void LatticeAgreement::propose(prop_nb_t instance_id, std::set<proposal_t> propo
   // }
   // std::cout << "}\n";
 
-  tryAddingInstance(instance_id);
+  // Proposals are sequential: every instance before this one has been decided locally
+  node_progress[parent->id - 1].store(instance_id);
+  collectGarbage();
+
   // add proposal
-  instances[instance_id]->propose(std::move(proposal));
+  auto instance = getInstance(instance_id);
+  if (instance) instance->propose(std::move(proposal));
+}
+
+std::optional<std::set<proposal_t>> LatticeAgreement::waitUntilDecidedOrTerminated(prop_nb_t instance_id)
+{
+  auto instance = instances.find(instance_id);
+  if (!instance) return std::nullopt;
+  return instance->waitUntilDecidedOrTerminated();
 }
 
-void LatticeAgreement::waitUntilDecidedOrTerminated(prop_nb_t instance_id)
+std::optional<std::set<proposal_t>> LatticeAgreement::pollDecision(prop_nb_t instance_id)
 {
-  instances[instance_id]->waitUntilDecidedOrTerminated();
+  auto instance = instances.find(instance_id);
+  if (!instance) return std::nullopt;
+  return instance->pollDecision();
 }
 
 void LatticeAgreement::terminate()
 {
-  for (const auto& instance: instances)
+  terminated.store(true);
+  instances.for_each([](const prop_nb_t&, LatticeAgreementInstance& instance) {
+    instance.terminate();
+  });
+}
+
+void LatticeAgreement::writeMetrics(std::ostream& os)
+{
+  os << "la.instances_live " << instances.size() << "\n"
+     << "la.instances_created " << created_instances.load() << "\n"
+     << "la.instances_decided " << metrics.instances_decided.load() << "\n"
+     << "la.rounds " << metrics.rounds.load() << "\n"
+     << "la.acks_received " << metrics.acks_received.load() << "\n"
+     << "la.nacks_received " << metrics.nacks_received.load() << "\n"
+     << "la.acks_sent " << metrics.acks_sent.load() << "\n"
+     << "la.nacks_sent " << metrics.nacks_sent.load() << "\n"
+     << "la.instances_freed " << freed_instances.load() << "\n";
+
+  // Each slot holds a shared pointer to an instance allocated together with its control block
+  size_t slot_size = 2 * sizeof(std::shared_ptr<LatticeAgreementInstance>);
+  size_t bytes = 0;
+  instances.for_each([&](const prop_nb_t&, LatticeAgreementInstance& instance) {
+    bytes += slot_size + instance.memoryFootprint();
+  });
   {
-    instance.second->terminate();
+    std::lock_guard<Mutex> lock(retired_mutex);
+    os << "la.instances_retired " << retired.size() << "\n";
+    // Each map node holds the key, the vector and three pointers and a color
+    for (const auto& [instance_id, accepted]: retired) {
+      bytes += sizeof(prop_nb_t) + sizeof(accepted) + 4 * sizeof(void *) + accepted.capacity() * sizeof(proposal_t);
+    }
   }
+  os << "la.instance_bytes " << bytes << "\n";
+
+  metrics.queue_wait_us.writeSummary(os, "la.queue_wait_us");
+  metrics.first_response_us.writeSummary(os, "la.first_response_us");
+  metrics.decision_us.writeSummary(os, "la.decision_us");
+  metrics.end_to_end_us.writeSummary(os, "la.end_to_end_us");
+  metrics.rounds_per_instance.writeSummary(os, "la.rounds_per_instance");
+  metrics.rounds_per_instance.writeDistribution(os, "la.rounds_per_instance.bucket");
 }
 
 // Private methods:
-void LatticeAgreement::tryAddingInstance(prop_nb_t instance_id)
+std::shared_ptr<LatticeAgreementInstance> LatticeAgreement::getInstance(prop_nb_t instance_id)
+{
+  auto [instance, created] = instances.get_or_create(instance_id);
+  if (created) created_instances.fetch_add(1);
+  return instance;
+}
+
+void LatticeAgreement::updatePeerProgress(proc_id_t node_id, const Message& msg)
+{
+  size_t index = node_id - 1;
+  node_last_heard[index].store(parent->clock().time_since_epoch().count(), std::memory_order_relaxed);
+
+  // A node only proposes in an instance once it has decided all previous ones
+  if (msg.type == MessageType::MES) 
+  {
+    prop_nb_t progress = node_progress[index].load();
+    while (progress < msg.instance && !node_progress[index].compare_exchange_weak(progress, msg.instance)) {}
+  }
+}
+
+void LatticeAgreement::collectGarbage()
 {
-  // Create instance if it does not exist
-  if (instances.find(instance_id) == instances.end())
+  int64_t now = parent->clock().time_since_epoch().count();
+  int64_t suspect_timeout = std::chrono::nanoseconds(std::chrono::milliseconds(LA_SUSPECT_TIMEOUT_MS)).count();
+  size_t self = parent->id - 1;
+
+  // Low-watermark: lowest instance still proposed in by this node or by a node that is not suspected to have crashed.
+  // Floor: lowest instance still proposed in by any node, below which no proposal can arrive anymore.
+  prop_nb_t watermark = node_progress[self].load();
+  prop_nb_t floor = watermark;
+  for (size_t i = 0; i < nb_nodes; i++)
   {
-    instances.emplace(instance_id, std::make_unique<LatticeAgreementInstance>(
-      nb_nodes, distinct_values, parent, instance_id
-    ));
+    if (i == self) continue;
+    prop_nb_t progress = node_progress[i].load();
+    floor = std::min(floor, progress);
+    if (now - node_last_heard[i].load(std::memory_order_relaxed) > suspect_timeout) continue;
+    watermark = std::min(watermark, progress);
   }
+
+  // Free all instances below the watermark, keeping the accepted set of those above the floor for the suspected 
+  // nodes. The instances are retired with retired_mutex held, so that a message finding its instance retired 
+  // finds its accepted set in retired.
+  std::lock_guard<Mutex> lock(retired_mutex);
+  freed_instances.fetch_add(instances.advance_base(watermark, [&](const prop_nb_t& instance_id, LatticeAgreementInstance& instance) {
+    std::vector<proposal_t> accepted = instance.retire();
+    if (instance_id >= floor) retired.emplace(instance_id, std::move(accepted));
+  }));
+  retired.erase(retired.begin(), retired.lower_bound(floor));
+}
+
+bool LatticeAgreement::processRetired(const std::shared_ptr<const Message>& msg, const std::string& sender_ip_and_port)
+{
+  std::lock_guard<Mutex> lock(retired_mutex);
+  auto accepted = retired.find(msg->instance);
+  if (accepted == retired.end()) return false;
+
+  bool acknowledge = accept(accepted->second, *msg);
+  LatticeAgreementInstance::respond(parent, *msg, sender_ip_and_port, accepted->second, acknowledge);
+  return true;
 }
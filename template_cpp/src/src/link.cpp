@@ -1,28 +1,100 @@
 #include "link.hpp"
+#include "probes.hpp"
 
-PerfectLink::PerfectLink(int socket, sockaddr_in source_addr, sockaddr_in dest_addr)
-  : socket(socket), source_addr(source_addr), dest_addr(dest_addr), 
-    packet_queue(), pending_pkts(true), delivered_pkts()
+SendBatch::SendBatch(Transport& transport)
+  : transport(transport)
+{
+  arena.reserve(SEND_BATCH_SIZE * Packet::ack_max_serialized_size);
+  offsets.reserve(SEND_BATCH_SIZE);
+  datagrams.reserve(SEND_BATCH_SIZE);
+}
+
+size_t SendBatch::add(const Packet& packet, const sockaddr_in& dest)
+{
+  if (offsets.size() == SEND_BATCH_SIZE) flush();
+
+  size_t offset = arena.size();
+  arena.resize(offset + packet.serializedSize());
+  size_t len = packet.serialize(arena.data() + offset);
+
+  offsets.push_back(offset);
+  datagrams.push_back(Datagram{nullptr, len, dest});
+  return len;
+}
+
+void SendBatch::flush()
+{
+  if (datagrams.empty()) return;
+
+  // Point the datagrams into the arena (it does not move until cleared)
+  for (size_t i = 0; i < datagrams.size(); i++) {
+    datagrams[i].data = arena.data() + offsets[i];
+  }
+  transport.send(datagrams.data(), datagrams.size());
+
+  arena.clear();
+  offsets.clear();
+  datagrams.clear();
+}
+
+bool SendPacer::due(clock::time_point now) const
+{
+  return now.time_since_epoch().count() >= next_round_.load(std::memory_order_relaxed);
+}
+
+SendPacer::clock::time_point SendPacer::nextRound() const
+{
+  return clock::time_point(clock::duration(next_round_.load(std::memory_order_relaxed)));
+}
+
+void SendPacer::roundSent(clock::time_point now, bool acked, bool lost)
+{
+  double rate = rate_.load(std::memory_order_relaxed);
+  if (lost) rate = std::max(PACING_MIN_RATE, rate * PACING_DECREASE_FACTOR);
+  else if (acked) rate = std::min(PACING_MAX_RATE, rate + PACING_RATE_INCREASE);
+  rate_.store(rate, std::memory_order_relaxed);
+
+  auto interval = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / rate));
+  next_round_.store((now + interval).time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+bool SendPacer::slowDown()
+{
+  double rate = rate_.load(std::memory_order_relaxed);
+  if (rate <= PACING_MIN_RATE) return false;
+  rate_.store(std::max(PACING_MIN_RATE, rate * PACING_DECREASE_FACTOR), std::memory_order_relaxed);
+  return true;
+}
+
+PerfectLink::PerfectLink(Transport& transport, sockaddr_in source_addr, sockaddr_in dest_addr, proc_id_t peer,
+                         const Tunables& tunables)
+  : transport(transport), source_addr(source_addr), dest_addr(dest_addr), peer(peer), 
+    packet_queue(), pending_pkts(true), delivered_pkts(),
+    window_size(tunables.send_window), messages_per_packet(tunables.messages_per_packet)
 {}
 
 void PerfectLink::enqueueMessage(std::shared_ptr<Message> msg)
 {
   // Create message
-  link_seq++;
-  std::pair<pkt_seq_t, std::shared_ptr<Message>> messageTuple = std::make_pair(link_seq, msg);
+  pkt_seq_t seq = link_seq.fetch_add(1) + 1;
+  std::pair<pkt_seq_t, std::shared_ptr<Message>> messageTuple = std::make_pair(seq, msg);
   
   // Append message to end of message queue
   packet_queue.push_back(messageTuple); 
 }
 
-void PerfectLink::send()
+size_t PerfectLink::send(SendBatch& batch)
 {
   // No packets to send
-  if (pending_pkts.empty() && packet_queue.empty()) return;
+  if (pending_pkts.empty() && packet_queue.empty()) return 0;
 
   // Complete pending_pkts set with messages from packet_queue and get snapshot of new pending_pkts set
-  const auto& [setSnapshot, size] = pending_pkts.complete(packet_queue);
+  // (one buffer per sender thread, reused across rounds and links)
+  thread_local std::vector<std::pair<pkt_seq_t, std::shared_ptr<Message>>> setSnapshot;
+  size_t size = pending_pkts.complete(packet_queue, size_t{window_size} * messages_per_packet, setSnapshot);
   size_t it = 0;
+  size_t total_retransmitted = 0;
+  pkt_seq_t previous_max = max_sent_seq.load(std::memory_order_relaxed);
 
   // std::cout << "packet_queue size: " << packet_queue.size() << ", pending_messages size: " << pending_pkts.size() << std::endl;
   for (size_t i = 0; i < window_size; i++) {
@@ -30,26 +102,26 @@ void PerfectLink::send()
     std::array<std::shared_ptr<const Message>, MAX_MESSAGES_PER_PACKET> msgs;
 
     uint8_t count = 0;
-    for (; count < Packet::max_msgs && it < size; count++, it++) {
+    uint8_t retransmitted = 0;
+    for (; count < messages_per_packet && it < size; count++, it++) {
       seqs[count] = setSnapshot[it].first;
       msgs[count] = setSnapshot[it].second;
+      if (seqs[count] <= previous_max) retransmitted++;
     }
     
     Packet packet(MES, count, seqs, msgs);
     // packet.displayPacket();
-    // Packet::displaySerialized(packet.serialize());
     // std::cout << std::endl;
   
-    // Send packet to receiver
-    if (sendto(socket, packet.serialize(), packet.serializedSize(), 0, reinterpret_cast<const sockaddr *>(&dest_addr), sizeof(dest_addr)) < 0) {
-      std::ostringstream os;
-      os << "Failed to send packet (errno: " << strerror(errno) << ")from " << source_addr.sin_addr.s_addr << ":" << source_addr.sin_port << " to " << dest_addr.sin_addr.s_addr << ":" << dest_addr.sin_port;
-      std::cout << os.str() << "\n";
-      continue;
-      // throw std::runtime_error(os.str());
-    }
-
-    // std::cout << "Packet sent successfully." << std::endl;
+    // Add packet to the sender's batch
+    size_t len = batch.add(packet, dest_addr);
+    if (trace != nullptr) trace->record(TraceKind::SENT, peer, packet);
+    metrics.packets_sent.add();
+    metrics.bytes_sent.add(len);
+    metrics.messages_retransmitted.add(retransmitted);
+    total_retransmitted += retransmitted;
+    DA_PROBE4(packet_sent, peer, seqs[0], count, retransmitted);
+    if (retransmitted > 0) DA_PROBE3(packet_retransmitted, peer, seqs[0], retransmitted);
 
     // Terminate if all messages have been sent
     if (it == size) {
@@ -57,9 +129,49 @@ void PerfectLink::send()
       break;
     }
   }
+
+  // The snapshot is ordered by sequence number
+  if (it > 0 && setSnapshot[it - 1].first > previous_max) {
+    max_sent_seq.store(setSnapshot[it - 1].first, std::memory_order_relaxed);
+  }
+  return total_retransmitted;
+}
+
+void PerfectLink::sendPaced(SendBatch& batch, SendPacer::clock::time_point now)
+{
+  if (!pacer.due(now) || (pending_pkts.empty() && packet_queue.empty())) return;
+
+  bool acked = acked_since_round.exchange(false, std::memory_order_relaxed);
+  size_t retransmitted = send(batch);
+  bool lost = retransmitted > 0 && !acked;
+  if (lost) metrics.rate_decreases.add();
+  pacer.roundSent(now, acked, lost);
+}
+
+void PerfectLink::slowDown()
+{
+  if (pacer.slowDown()) metrics.rate_decreases.add();
 }
 
-std::array<bool, MAX_MESSAGES_PER_PACKET> PerfectLink::receive(Packet packet)
+size_t PerfectLink::backlog() const
+{
+  return packet_queue.size() + pending_pkts.size();
+}
+
+void PerfectLink::writeMetrics(std::ostream& os, const std::string& prefix) const
+{
+  os << prefix << ".packets_sent " << metrics.packets_sent.load() << "\n"
+     << prefix << ".bytes_sent " << metrics.bytes_sent.load() << "\n"
+     << prefix << ".messages_retransmitted " << metrics.messages_retransmitted.load() << "\n"
+     << prefix << ".messages_acked " << metrics.messages_acked.load() << "\n"
+     << prefix << ".acks_sent " << metrics.acks_sent.load() << "\n"
+     << prefix << ".send_rate " << pacer.rate() << "\n"
+     << prefix << ".rate_decreases " << metrics.rate_decreases.load() << "\n"
+     << prefix << ".queue_depth " << packet_queue.size() << "\n"
+     << prefix << ".pending_depth " << pending_pkts.size() << "\n";
+}
+
+std::array<bool, MAX_MESSAGES_PER_PACKET> PerfectLink::receive(const Packet& packet)
 {
   MessageType type = packet.getType();
 
@@ -69,20 +181,21 @@ std::array<bool, MAX_MESSAGES_PER_PACKET> PerfectLink::receive(Packet packet)
 
     // Transform message to ack and serialize
     Packet ack_pkt = packet.toAck();
+    std::array<char, Packet::ack_max_serialized_size> ack_buffer;
+    size_t ack_len = ack_pkt.serialize(ack_buffer.data());
 
-    // Send ACK to sender
-    if (sendto(socket, ack_pkt.serialize(), ack_pkt.serializedSize(), 0, reinterpret_cast<const sockaddr *>(&dest_addr), sizeof(dest_addr)) < 0) {
-      std::ostringstream os;
-      os << "Failed to send ACK (errno: " << strerror(errno) << ") from " << source_addr.sin_addr.s_addr << ":" << source_addr.sin_port << " to " << dest_addr.sin_addr.s_addr << ":" << dest_addr.sin_port;
-      std::cout << os.str() << "\n";
-      return {};
-      // throw std::runtime_error(os.str());
-    }
+    // Send ACK to sender (the messages are delivered even if it is lost: the sender retransmits and the duplicates are dropped)
+    Datagram ack{ack_buffer.data(), ack_len, dest_addr};
+    transport.send(&ack, 1);
+    metrics.acks_sent.add();
     return delivery_status;
   }
   else if (type == ACK) {
     // Remove messages acknowledged by receiver
-    pending_pkts.erase(packet.getSeqs());
+    size_t acked = pending_pkts.erase(packet.getSeqs());
+    metrics.messages_acked.add(acked);
+    if (acked > 0) DA_PROBE3(packet_acked, peer, packet.getSeqs()[0], acked);
+    if (acked > 0) acked_since_round.store(true, std::memory_order_relaxed);
     return {};
   }
   else {
@@ -0,0 +1,111 @@
+#include "lock_profile.hpp"
+
+#ifdef DA_LOCK_PROFILING
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+uint64_t nanosecondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+// Statistics of every name. Never freed: locks may still be used by static objects destroyed after the report.
+struct Registry {
+  std::mutex mutex;
+  std::map<std::string, std::unique_ptr<LockStats>> stats;
+};
+
+void reportAtExit()
+{
+  writeLockProfile(std::cerr);
+}
+
+Registry &registry()
+{
+  static Registry *instance = [] {
+    std::atexit(reportAtExit);
+    return new Registry();
+  }();
+  return *instance;
+}
+
+} // namespace
+
+Mutex::Mutex(const char *name)
+  : stats([name]() -> LockStats& {
+      Registry &reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      auto &entry = reg.stats[name];
+      if (entry == nullptr) {
+        entry = std::make_unique<LockStats>();
+        entry->name = name;
+      }
+      return *entry;
+    }())
+{}
+
+void Mutex::lock()
+{
+  if (!mutex.try_lock()) {
+    auto start = std::chrono::steady_clock::now();
+    mutex.lock();
+    locked_at = std::chrono::steady_clock::now();
+    stats.contended.add();
+    stats.wait_ns.add(nanosecondsBetween(start, locked_at));
+  }
+  else {
+    locked_at = std::chrono::steady_clock::now();
+  }
+  stats.acquisitions.add();
+}
+
+bool Mutex::try_lock()
+{
+  if (!mutex.try_lock()) return false;
+  locked_at = std::chrono::steady_clock::now();
+  stats.acquisitions.add();
+  return true;
+}
+
+void Mutex::unlock()
+{
+  stats.hold_ns.add(nanosecondsBetween(locked_at, std::chrono::steady_clock::now()));
+  mutex.unlock();
+}
+
+void writeLockProfile(std::ostream &os)
+{
+  Registry &reg = registry();
+  std::vector<const LockStats*> ranked;
+  {
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto &[name, stats]: reg.stats) ranked.push_back(stats.get());
+  }
+  std::sort(ranked.begin(), ranked.end(), [](const LockStats *a, const LockStats *b) {
+    return a->wait_ns.load() > b->wait_ns.load();
+  });
+
+  os << "Lock profile (ranked by wait time)\n"
+     << std::left << std::setw(36) << "lock" << std::right
+     << std::setw(14) << "acquisitions" << std::setw(12) << "contended"
+     << std::setw(12) << "wait_ms" << std::setw(12) << "hold_ms" << std::setw(14) << "avg_wait_ns" << "\n";
+  for (const LockStats *stats: ranked) {
+    uint64_t contended = stats->contended.load();
+    os << std::left << std::setw(36) << stats->name << std::right
+       << std::setw(14) << stats->acquisitions.load() << std::setw(12) << contended
+       << std::setw(12) << stats->wait_ns.load() / 1000000 << std::setw(12) << stats->hold_ns.load() / 1000000
+       << std::setw(14) << (contended > 0 ? stats->wait_ns.load() / contended : 0) << "\n";
+  }
+}
+
+#endif
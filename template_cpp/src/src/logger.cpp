@@ -1,5 +1,8 @@
 #include "logger.hpp"
-#include <chrono>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 
 /**
  * Constructor to initialize the Logger with the specified log file path.
@@ -7,10 +10,13 @@
  */
 Logger::Logger(const std::string &path)
 {
-  log_file.open(path, std::ios::out);
-  if (!log_file.is_open()) {
+  fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
     throw std::runtime_error("Logger: failed to open log file: " + path);
   }
+
+  active.data.resize(LOG_BUFFER_BYTES);
+  spare.data.resize(LOG_BUFFER_BYTES);
 }
 
 /**
@@ -21,37 +27,50 @@ Logger::~Logger()
   cleanup();
 }
 
-void Logger::logDecision(std::set<proposal_t>& proposals)
+void Logger::logDecision(const std::set<proposal_t>& proposals)
 {
-  std::ostringstream os;
-  auto it = proposals.begin();
-  os << *it; it++; // peek at first element (avoids trailing whitespace after last element)
+  // Space separated decimal values and a newline
+  constexpr size_t max_digits = 10;
+  size_t max_line = proposals.size() * (max_digits + 1) + 1;
+
+  MutexLock lk(mutex);
+  if (active.used + max_line > active.data.size()) {
+    active.data.resize(std::max(2 * active.data.size(), active.used + max_line));
+  }
 
-  // Add all elements to string
-  for (; it != proposals.end(); it++)
+  char *out = active.data.data() + active.used;
+  char *end = active.data.data() + active.data.size();
+  for (auto it = proposals.begin(); it != proposals.end(); it++)
   {
-    os << " " << *it;
+    // separator before every element but the first (avoids trailing whitespace after last element)
+    if (it != proposals.begin()) *out++ = ' ';
+    out = std::to_chars(out, end, *it).ptr;
   }
-  enqueueLine(os.str());  
+  *out++ = '\n';
+  active.used = static_cast<size_t>(out - active.data.data());
+
+  // Wake up the writer early when enough is buffered
+  bool flush_needed = active.used >= LOG_FLUSH_BYTES;
+  lk.unlock();
+  if (flush_needed) cv.notify_one();
 }
 
-/**
- * Enqueues a log line to be written to the log file.
- * @param line The log line to enqueue.
- */
-void Logger::enqueueLine(const std::string &line)
+void Logger::waitForFlush(std::chrono::milliseconds timeout)
 {
-  std::lock_guard<std::mutex> lk(mutex);
-  queue.push_back(line);
+  MutexLock lk(mutex);
+  cv.wait_for(lk, timeout, [this]() {
+    return wake_up || active.used >= LOG_FLUSH_BYTES;
+  });
+  wake_up = false;
 }
 
-/**
- * Flushes the log file by writing all enqueued log lines.
- */
-void Logger::flush()
+void Logger::wakeUp()
 {
-  // ensure file is flushed
-  if (log_file.is_open()) log_file.flush();
+  {
+    std::lock_guard<Mutex> lk(mutex);
+    wake_up = true;
+  }
+  cv.notify_all();
 }
 
 /**
@@ -59,34 +78,35 @@ void Logger::flush()
  */
 void Logger::cleanup()
 {
-  running.store(false);
-  log_file.close();
+  std::lock_guard<Mutex> wlk(write_mutex);
+  if (fd >= 0) ::close(fd);
+  fd = -1;
 }
 
 /**
- * Writes enqueued log lines to the log file.
+ * Writes the buffered decisions to the log file.
  */
 void Logger::write()
 {
-  // std::cout << queue.size() << " log lines to write." << std::endl;
-  std::vector<std::string> local {};
-  // swap shared queue into local buffer under lock
+  // Serialize writers so that buffers reach the file in order
+  std::lock_guard<Mutex> wlk(write_mutex);
+
+  // swap the filled buffer with the spare one under lock
   {
-    std::lock_guard<std::mutex> lk(mutex);
-    local.swap(queue);
+    std::lock_guard<Mutex> lk(mutex);
+    std::swap(active, spare);
   }
 
-  if (!local.empty() && log_file.is_open()) {
-    // accumulate into one string to minimize syscalls
-    std::string out;
-    size_t approx = 0;
-    for (auto &s : local) approx += s.size() + 1;
-    out.reserve(approx);
-    for (auto &s : local) {
-      out += s;
-      out.push_back('\n');
+  // std::cout << spare.used << " log bytes to write." << std::endl;
+  size_t written = 0;
+  while (fd >= 0 && written < spare.used) {
+    ssize_t res = ::write(fd, spare.data.data() + written, spare.used - written);
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      std::cout << "Logger: failed to write log file (errno: " << strerror(errno) << ")\n";
+      break;
     }
-
-    log_file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    written += static_cast<size_t>(res);
   }
-}
\ No newline at end of file
+  spare.used = 0;
+}
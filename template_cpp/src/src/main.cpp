@@ -4,39 +4,74 @@
 #include <string>
 #include <thread>
 #include <memory>
+#include <mutex>
 #include <signal.h>
+#include <pthread.h>
+#include <cerrno>
+#include <ctime>
 
 #include "parser.hpp"
 #include "node.hpp"
 #include "helper.hpp"
 #include "globals.hpp"
+#include "config.hpp"
+#include "options.hpp"
+#include "transport.hpp"
+#include "uring.hpp"
+#include "trace.hpp"
 
 static Node* p_node = nullptr;
+static std::string metrics_path;
+static std::once_flag stop_once;
 
+// Never runs in signal context: termination signals are handled by a dedicated thread (see handleSignals)
 static void stop(int) {
-  // reset signal handlers to default
-  signal(SIGTERM, SIG_DFL);
-  signal(SIGINT, SIG_DFL);
-  
-  // immediately stop network packet processing
-  std::cout << "Immediately stopping network packet processing." << std::endl;
-  p_node->terminate();
-  
-  // write/flush output file if necessary
-  std::cout << "Writing output." << std::endl;
-  p_node->flushToOutput();
+  std::call_once(stop_once, []() {
+    // write decided values first (plain write(2) of the pre-formatted buffer), 
+    // so that they are on file even if we are killed during the teardown
+    p_node->flushToOutput();
+    std::cout << "Output written." << std::endl;
+
+    // immediately stop network packet processing
+    std::cout << "Immediately stopping network packet processing." << std::endl;
+    p_node->terminate();
+    p_node->displayWorkerStats();
+    
+    // write values decided during the teardown
+    std::cout << "Writing output." << std::endl;
+    p_node->flushToOutput();
+    p_node->writeMetrics(metrics_path);
 
-  // Clean up resources
-  std::cout << "Cleaning up resources." << std::endl;
-  p_node->cleanup();
+    // Clean up resources
+    std::cout << "Cleaning up resources." << std::endl;
+    p_node->cleanup();
+
+    exit(0);
+  });
+}
 
-  // exit directly from signal handler
-  exit(0);
+/**
+ * Signal thread: dumps the metrics every METRICS_INTERVAL_MS and on SIGUSR1, stops the node on a termination signal
+ */
+static void handleSignals(sigset_t signals) {
+  timespec interval{METRICS_INTERVAL_MS / 1000, (METRICS_INTERVAL_MS % 1000) * 1000000L};
+  while (true) {
+    int sig = sigtimedwait(&signals, nullptr, &interval);
+    if (sig == SIGTERM || sig == SIGINT) break;
+    if (sig == SIGUSR1 || (sig < 0 && errno == EAGAIN)) p_node->writeMetrics(metrics_path);
+  }
+  stop(0);
 }
 
 int main(int argc, char **argv) {
-  signal(SIGTERM, stop);
-  signal(SIGINT, stop);
+  // Block termination and metrics signals in this thread and, by inheritance, in every thread of the node.
+  // They are received synchronously by the signal thread started once the node exists.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
 
   // `true` means that a config file is required.
   // Call with `false` if no config file is necessary.
@@ -44,6 +79,13 @@ int main(int argc, char **argv) {
 
   Parser parser(argc, argv);
   parser.parse();
+  RuntimeOptions options;
+  try {
+    options = RuntimeOptions::parse(argc, argv, 8);
+  } catch (const std::invalid_argument& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
 
   std::cout << std::endl;
 
@@ -77,33 +119,47 @@ int main(int argc, char **argv) {
 
   std::cout << "Doing some initialization...\n" << std::endl;
 
-  // Open config file
-  std::ifstream configFile(parser.configPath());
-  if (!configFile.is_open()) {
-    std::ostringstream os;
-    os << "`" << parser.configPath() << "` does not exist";
-    throw std::invalid_argument(os.str());
-  }
-
-  // Extract first line of config file
-  std::string config;
-  if (!std::getline(configFile, config)) {
-    std::ostringstream os;
-    os << "`" << parser.configPath() << "` file empty or error handling file";
-    throw std::invalid_argument(os.str());
-  }
-
-  // Extract lattice agreement parameters (p, vs, ds)
-  std::istringstream iss(config);
-  prop_nb_t shots; uint32_t vs; uint32_t ds;
-  if (!(iss >> shots >> vs >> ds)) {
-    throw std::invalid_argument("Error parsing integers from config file");
-  }
+  // Open config file and extract lattice agreement parameters (p, vs, ds)
+  ConfigReader config(parser.configPath());
+  prop_nb_t shots = config.shots(); uint32_t vs = config.vs(); uint32_t ds = config.ds();
   
   // Create node
   std::cout << "Creating nodes for lattice agreement (p=" << shots << ", vs=" << vs << ", ds=" << ds << ")\n" << std::endl;
-  Node node(hosts, parser.id(), parser.outputPath(), ds);
+  UdpConfig udp_config;
+  udp_config.sockets = options.listeners;
+  udp_config.steer_by_source = options.steering == RuntimeOptions::Steering::SOURCE;
+  udp_config.receive_buffer = options.receive_buffer;
+  udp_config.send_buffer = options.send_buffer;
+  udp_config.offload = options.offload;
+  udp_config.busy_poll_us = options.busy_poll_us;
+
+  std::unique_ptr<Transport> transport;
+  if (options.transport == RuntimeOptions::TransportKind::SHM) {
+    transport = std::make_unique<ShmTransport>(hosts, parser.id(), udp_config);
+  }
+  else if (options.io == RuntimeOptions::IoEngine::URING) {
+    try {
+      transport = std::make_unique<UringTransport>(setupIpAddress(hosts[parser.id() - 1]), udp_config);
+    } catch (const std::runtime_error& e) {
+      std::cout << e.what() << ", falling back to sockets\n" << std::endl;
+    }
+  }
+  if (transport == nullptr) {
+    transport = std::make_unique<UdpTransport>(setupIpAddress(hosts[parser.id() - 1]), udp_config);
+  }
+  Node node(hosts, parser.id(), parser.outputPath(), ds, std::move(transport), options.tunables);
+  node.pinThreads(options.affinity);
+  if (!options.trace.empty()) {
+    try {
+      node.traceTo(std::make_unique<TraceWriter>(options.trace, hosts, parser.id(), ds));
+    } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
   p_node = &node;
+  metrics_path = std::string(parser.outputPath()) + ".metrics";
+  std::thread(handleSignals, signals).detach();
 
   try {
     // Start node (sending, listening and logging)
@@ -113,26 +169,14 @@ int main(int argc, char **argv) {
     // Start clock to measure Sender execution time
     // auto start_time = std::chrono::high_resolution_clock::now();
         
-    // Start enqueueing messages if this is a sender
-    for (size_t i = 0; i < shots; i++) {
-      std::string line;
-      if (!std::getline(configFile, line)) {
-        std::ostringstream os;
-        os << "`" << parser.configPath() << "` file empty or error handling file";
-        throw std::invalid_argument(os.str());
-      }
-      std::istringstream line_stream(line);
-
-      // Create proposal set
-      std::set<proposal_t> proposal;
-      proposal_t element;
-      while (line_stream >> element)
-      {
-        proposal.insert(element); 
-      }
-      
-      // Propose to node
-      node.propose(std::move(proposal));
+    // Read proposals in batches, staying at most PROPOSAL_QUEUE_LIMIT proposals ahead of the node
+    // Each batch stays in its arena until the proposer thread takes its proposals
+    while (config.remaining() > 0) {
+      if (!node.waitForProposalCapacity(std::chrono::milliseconds(100))) continue;
+
+      auto arena = std::make_shared<ProposalArena>();
+      config.read(*arena, CONFIG_READ_BATCH);
+      node.proposeMany(std::move(arena));
     }
   
     std::cout << "All proposals enqueued.\n" << std::endl;
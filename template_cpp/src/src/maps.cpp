@@ -1,4 +1,5 @@
 #include "maps.hpp"
+#include "lattice_agreement.hpp"
 
 // ===================== ConcurrentMap start ===================== //
 template <typename Key, typename Value, typename Compare>
@@ -15,14 +16,14 @@ ConcurrentMap<Key, Value, Compare>::ConcurrentMap(bool bounded)
 template <typename Key, typename Value, typename Compare>
 bool ConcurrentMap<Key, Value, Compare>::empty() const
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return map_.empty();
 }
 
 template <typename Key, typename Value, typename Compare>
 std::size_t ConcurrentMap<Key, Value, Compare>::size() const
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return map_.size();
 }
 
@@ -32,7 +33,7 @@ std::pair<typename ConcurrentMap<Key, Value, Compare>::iterator, bool>
 ConcurrentMap<Key, Value, Compare>::insert(const Key &key, const Value &value)
 {
   assert(!bounded_);
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
 
   // Insert only if key not present
   return map_.emplace(key, value);
@@ -41,59 +42,59 @@ ConcurrentMap<Key, Value, Compare>::insert(const Key &key, const Value &value)
 template <typename Key, typename Value, typename Compare>
 void ConcurrentMap<Key, Value, Compare>::erase(const Key &key)
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   map_.erase(key);
 }
 
 template <typename Key, typename Value, typename Compare>
 void ConcurrentMap<Key, Value, Compare>::erase(const std::vector<Key> &keys)
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   for (const Key &k : keys) {
     map_.erase(k);
   }
 }
 
 template <typename Key, typename Value, typename Compare>
-void ConcurrentMap<Key, Value, Compare>::erase(const std::array<Key, MAX_MESSAGES_PER_PACKET> &keys)
+std::size_t ConcurrentMap<Key, Value, Compare>::erase(const std::array<Key, MAX_MESSAGES_PER_PACKET> &keys)
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
+  std::size_t erased = 0;
   for (const Key &key: keys)
   {
-    map_.erase(key);
+    erased += map_.erase(key);
   }
+  return erased;
 }
 
 template <typename Key, typename Value, typename Compare>
-std::pair<std::array<typename ConcurrentMap<Key, Value, Compare>::value_type, ConcurrentMap<Key, Value, Compare>::max_size>, size_t> ConcurrentMap<Key, Value, Compare>::complete(ConcurrentDeque<std::pair<Key, Value>> &queue)
+std::size_t ConcurrentMap<Key, Value, Compare>::complete(ConcurrentDeque<std::pair<Key, Value>> &queue, std::size_t limit, std::vector<std::pair<Key, Value>> &snapshot)
 {
   assert(bounded_);
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
 
   // get size of map
   size_t map_size = map_.size();
 
   // insert k first elements of concurrent queue into map
-  for (const auto& [key, value]: queue.pop_k_front(max_size - map_size))
-  {
-    map_.emplace(key, value); 
+  if (map_size < limit) {
+    for (const auto& [key, value]: queue.pop_k_front(limit - map_size))
+    {
+      map_.emplace(key, value); 
+    }
   }
 
-  // return snapshot of map
-  std::array<value_type, ConcurrentMap<Key, Value, Compare>::max_size> result;  
-  size_t i = 0;
-  for (const auto &p : map_) {
-    new (&result[i]) value_type(p.first, p.second);
-    i++;
-  }
-  return std::make_pair(result, i);
+  // copy the map into the caller's buffer (it keeps its capacity between calls)
+  snapshot.clear();
+  snapshot.insert(snapshot.end(), map_.begin(), map_.end());
+  return snapshot.size();
 }
 
 // Helpers for container-like Value
 template <typename Key, typename Value, typename Compare>
 template <typename Member>
 bool ConcurrentMap<Key, Value, Compare>::add_to_mapped_set(const Key &key, const Member &member) {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   auto it = map_.find(key);
   if (it == map_.end()) {
     auto p = map_.emplace(key, Value{}).first;
@@ -106,7 +107,7 @@ bool ConcurrentMap<Key, Value, Compare>::add_to_mapped_set(const Key &key, const
 
 template <typename Key, typename Value, typename Compare>
 size_t ConcurrentMap<Key, Value, Compare>::mapped_set_size(const Key &key) const {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   auto it = map_.find(key);
   if (it == map_.end()) return 0;
   return it->second.size();
@@ -114,7 +115,7 @@ size_t ConcurrentMap<Key, Value, Compare>::mapped_set_size(const Key &key) const
 
 template <typename Key, typename Value, typename Compare>
 Value ConcurrentMap<Key, Value, Compare>::get_mapped_copy(const Key &key) const {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   auto it = map_.find(key);
   if (it == map_.end()) return Value{};
   return it->second;
@@ -125,14 +126,14 @@ template <typename Key, typename Value, typename Compare>
 typename ConcurrentMap<Key, Value, Compare>::iterator
 ConcurrentMap<Key, Value, Compare>::find(const Key &key)
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return map_.find(key);
 }
 
 template <typename Key, typename Value, typename Compare>
 bool ConcurrentMap<Key, Value, Compare>::contains(const Key &key) const
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return map_.find(key) != map_.end();
 }
 
@@ -140,7 +141,7 @@ template <typename Key, typename Value, typename Compare>
 std::vector<typename ConcurrentMap<Key, Value, Compare>::value_type>
 ConcurrentMap<Key, Value, Compare>::snapshot() const
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   std::vector<value_type> s;
   s.reserve(map_.size());
   for (const auto &p : map_) {
@@ -150,7 +151,116 @@ ConcurrentMap<Key, Value, Compare>::snapshot() const
 }
 // ===================== ConcurrentMap end ===================== //
 
+// ===================== ShardedWindowMap start ===================== //
+template <typename Key, typename T>
+ShardedWindowMap<Key, T>::ShardedWindowMap(factory_type make)
+  : make_(std::move(make))
+{}
+
+// Capacity methods
+template <typename Key, typename T>
+std::size_t ShardedWindowMap<Key, T>::size() const
+{
+  std::size_t total = 0;
+  for (const Shard &shard: shards_) {
+    std::lock_guard<Mutex> g(shard.mutex_);
+    total += shard.count;
+  }
+  return total;
+}
+
+template <typename Key, typename T>
+Key ShardedWindowMap<Key, T>::base() const
+{
+  return base_.load();
+}
+
+// Modifiers
+template <typename Key, typename T>
+std::pair<typename ShardedWindowMap<Key, T>::pointer, bool> ShardedWindowMap<Key, T>::get_or_create(const Key &key)
+{
+  Shard &shard = shards_[key % nb_shards];
+  Key local = static_cast<Key>(key / nb_shards);
+
+  std::lock_guard<Mutex> g(shard.mutex_);
+  // Key below the window: already freed. Far above it: not created, so that one bad key cannot grow a shard 
+  // to its value
+  Key base = base_.load();
+  if (key < base || local < shard.first) return std::make_pair(nullptr, false);
+  if (key - base >= max_window) return std::make_pair(nullptr, false);
+
+  size_t index = local - shard.first;
+  if (index >= shard.slots.size()) shard.slots.resize(index + 1);
+
+  pointer &slot = shard.slots[index];
+  if (slot) return std::make_pair(slot, false);
+
+  slot = make_(key);
+  shard.count++;
+  return std::make_pair(slot, true);
+}
+
+template <typename Key, typename T>
+std::size_t ShardedWindowMap<Key, T>::advance_base(const Key &new_base, const std::function<void(const Key&, T&)>& on_free)
+{
+  if (new_base <= base_.load()) return 0;
+  base_.store(new_base);
+
+  std::size_t freed = 0;
+  for (size_t s = 0; s < nb_shards; s++) {
+    Shard &shard = shards_[s];
+    // Number of keys k < new_base with k % nb_shards == s
+    Key new_first = static_cast<Key>(new_base > s ? (new_base - s + nb_shards - 1) / nb_shards : 0);
+
+    std::lock_guard<Mutex> g(shard.mutex_);
+    while (shard.first < new_first && !shard.slots.empty()) {
+      if (shard.slots.front()) {
+        if (on_free) on_free(static_cast<Key>(shard.first * nb_shards + s), *shard.slots.front());
+        shard.count--;
+        freed++;
+      }
+      shard.slots.pop_front();
+      shard.first++;
+    }
+    shard.first = std::max(shard.first, new_first);
+  }
+  return freed;
+}
+
+// Lookup
+template <typename Key, typename T>
+typename ShardedWindowMap<Key, T>::pointer ShardedWindowMap<Key, T>::find(const Key &key) const
+{
+  const Shard &shard = shards_[key % nb_shards];
+  Key local = static_cast<Key>(key / nb_shards);
+
+  std::lock_guard<Mutex> g(shard.mutex_);
+  if (key < base_.load() || local < shard.first) return nullptr;
+
+  size_t index = local - shard.first;
+  if (index >= shard.slots.size()) return nullptr;
+  return shard.slots[index];
+}
+
+template <typename Key, typename T>
+void ShardedWindowMap<Key, T>::for_each(const std::function<void(const Key&, T&)>& fn) const
+{
+  for (size_t s = 0; s < nb_shards; s++) {
+    const Shard &shard = shards_[s];
+
+    std::lock_guard<Mutex> g(shard.mutex_);
+    for (size_t i = 0; i < shard.slots.size(); i++) {
+      if (!shard.slots[i]) continue;
+      Key key = static_cast<Key>((shard.first + i) * nb_shards + s);
+      fn(key, *shard.slots[i]);
+    }
+  }
+}
+// ===================== ShardedWindowMap end ===================== //
+
 // Used in lattice_agreement.hpp
+template class ShardedWindowMap<prop_nb_t, LatticeAgreementInstance>;
+
 // Explicit instantiation for ConcurrentMap<uint32_t, std::set<proc_id_t>>
 template class ConcurrentMap<uint32_t, std::set<proc_id_t>>;
 template bool ConcurrentMap<uint32_t, std::set<proc_id_t>>::add_to_mapped_set<proc_id_t>(const uint32_t&, const proc_id_t&);
@@ -160,6 +270,7 @@ template bool ConcurrentMap<uint32_t, std::set<proc_id_t>>::add_to_mapped_set<pr
 // Only instantiate the methods actually used for this type
 template ConcurrentMap<pkt_seq_t, std::shared_ptr<Message>>::ConcurrentMap(bool);
 template bool ConcurrentMap<pkt_seq_t, std::shared_ptr<Message>>::empty() const;
-template std::pair<std::array<ConcurrentMap<pkt_seq_t, std::shared_ptr<Message>>::value_type, ConcurrentMap<pkt_seq_t, std::shared_ptr<Message>>::max_size>, size_t>
-  ConcurrentMap<pkt_seq_t, std::shared_ptr<Message>>::complete(ConcurrentDeque<std::pair<pkt_seq_t, std::shared_ptr<Message>>>&);
-template void ConcurrentMap<pkt_seq_t, std::shared_ptr<Message>>::erase(const std::array<pkt_seq_t, MAX_MESSAGES_PER_PACKET>&);
+template std::size_t ConcurrentMap<pkt_seq_t, std::shared_ptr<Message>>::size() const;
+template std::size_t
+  ConcurrentMap<pkt_seq_t, std::shared_ptr<Message>>::complete(ConcurrentDeque<std::pair<pkt_seq_t, std::shared_ptr<Message>>>&, std::size_t, std::vector<std::pair<pkt_seq_t, std::shared_ptr<Message>>>&);
+template std::size_t ConcurrentMap<pkt_seq_t, std::shared_ptr<Message>>::erase(const std::array<pkt_seq_t, MAX_MESSAGES_PER_PACKET>&);
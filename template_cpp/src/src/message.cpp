@@ -1,10 +1,41 @@
 #include "message.hpp"
 
+/**
+ * Read a field in network byte order at buffer + offset, advancing offset past it
+ */
+template<typename T>
+static T readField(const char *buffer, size_t len, size_t &offset)
+{
+  if (offset > len || len - offset < sizeof(T)) throw std::runtime_error("Truncated packet in deserialization");
+  T value;
+  std::memcpy(&value, buffer + offset, sizeof(T));
+  offset += sizeof(T);
+  return convertFromNetwork(value);
+}
+
 // =================== Message implementation =================== 
 Message::Message(MessageType type, prop_nb_t instance, prop_nb_t round, const std::set<proposal_t>& proposal_set)
   : type(type), instance(instance), round(round), proposed_values(proposal_set.begin(), proposal_set.end())
 {}
 
+Message::Message(MessageType type, prop_nb_t instance, prop_nb_t round, std::vector<proposal_t> sorted_values)
+  : type(type), instance(instance), round(round), proposed_values(std::move(sorted_values))
+{}
+
+Message::Message(const Message& other)
+  : type(other.type), instance(other.instance), round(other.round), proposed_values(other.proposed_values)
+{}
+
+Message& Message::operator=(const Message& other)
+{
+  type = other.type;
+  instance = other.instance;
+  round = other.round;
+  proposed_values = other.proposed_values;
+  wire_.reset();
+  return *this;
+}
+
 bool Message::operator==(const Message &other) const
 {
   if (proposed_values.size() != other.proposed_values.size()) return false;
@@ -18,10 +49,10 @@ bool Message::operator==(const Message &other) const
 
 Message Message::toAck() const
 {
-  return Message(MessageType::ACK, instance, round, {});
+  return Message(MessageType::ACK, instance, round, std::vector<proposal_t>{});
 }
 
-Message Message::toNack(std::set<proposal_t>& completed_proposal_set) const
+Message Message::toNack(const std::vector<proposal_t>& completed_proposal_set) const
 {
   return Message(MessageType::NACK, instance, round, completed_proposal_set);
 }
@@ -46,6 +77,32 @@ size_t Message::serializedSize() const
 }
 
 void Message::serializeTo(char *buffer, size_t &offset) const
+{
+  // Copy the cached encoding
+  const std::vector<char>& wire = wireImage();
+  std::memcpy(buffer + offset, wire.data(), wire.size());
+  offset += wire.size();
+}
+
+const std::vector<char>& Message::wireImage() const
+{
+  std::shared_ptr<const std::vector<char>> wire = std::atomic_load(&wire_);
+  if (!wire) {
+    auto encoded = std::make_shared<std::vector<char>>(serializedSize());
+    size_t offset = 0;
+    encodeTo(encoded->data(), offset);
+
+    // Another thread may have encoded the message concurrently: keep the first image
+    std::shared_ptr<const std::vector<char>> expected;
+    std::atomic_compare_exchange_strong(&wire_, &expected, std::shared_ptr<const std::vector<char>>(std::move(encoded)));
+    wire = std::atomic_load(&wire_);
+  }
+
+  // The image is owned by wire_, which is never replaced once set
+  return *wire;
+}
+
+void Message::encodeTo(char *buffer, size_t &offset) const
 {
   // serialize message type
   std::memcpy(buffer + offset, &type, sizeof(type));
@@ -74,37 +131,23 @@ void Message::serializeTo(char *buffer, size_t &offset) const
   }
 }
 
-Message Message::deserialize(const char *buffer, size_t &offset)
+Message Message::deserialize(const char *buffer, size_t len, size_t &offset)
 {
   Message msg;
   
-  std::memcpy(&msg.type, buffer + offset, sizeof(msg.type));
-  offset += sizeof(msg.type);
-  
-  prop_nb_t instance_network;
-  std::memcpy(&instance_network, buffer + offset, sizeof(instance_network));
-  offset += sizeof(instance_network);
-  msg.instance = convertFromNetwork(instance_network);
-  
-  prop_nb_t round_network;
-  std::memcpy(&round_network, buffer + offset, sizeof(round_network));
-  offset += sizeof(round_network);
-  msg.round = convertFromNetwork(round_network);
+  msg.type = readField<MessageType>(buffer, len, offset);
+  if (msg.type != MES && msg.type != ACK && msg.type != NACK) throw std::runtime_error("Unknown message type in deserialization");
+  msg.instance = readField<prop_nb_t>(buffer, len, offset);
+  msg.round = readField<prop_nb_t>(buffer, len, offset);
   
   // Deserialize to proposed_values
-  uint16_t set_size_network;
-  std::memcpy(&set_size_network, buffer + offset, sizeof(set_size_network));
-  offset += sizeof(set_size_network);
-  uint16_t set_size = convertFromNetwork(set_size_network);
-  msg.proposed_values.reserve(set_size);
+  uint16_t set_size = readField<uint16_t>(buffer, len, offset);
   if (set_size > MAX_PROPOSAL_SET_SIZE) throw std::runtime_error("Deserilized set size exceeds maximum proposal set size");
+  msg.proposed_values.reserve(set_size);
 
   for (size_t i = 0; i < set_size; i++)
   {
-    proposal_t prop_network;
-    std::memcpy(&prop_network, buffer + offset, sizeof(prop_network));
-    offset += sizeof(prop_network);
-    msg.proposed_values.push_back(convertFromNetwork(prop_network));
+    msg.proposed_values.push_back(readField<proposal_t>(buffer, len, offset));
   }
 
   return msg;
@@ -149,7 +192,7 @@ const std::array<pkt_seq_t, MAX_MESSAGES_PER_PACKET>& Packet::getSeqs() const
 /** 
  * Convert message to ACK type
  */
-Packet Packet::toAck()
+Packet Packet::toAck() const
 {
   assert (m_type == MES);
 
@@ -199,9 +242,9 @@ void Packet::displayPacket()
   std::cout << "" << std::endl;
 }
 
-void Packet::displaySerialized(const char* serialized)
+void Packet::displaySerialized(const char* serialized, size_t size)
 {
-  size_t len = Packet::deserialize(serialized).serializedSize();
+  size_t len = Packet::deserialize(serialized, size).serializedSize();
   std::cout << "Serialized message size: " << len << std::endl;
   std::cout << "Serialized message (hex): ";
   for (size_t i = 0; i < len; ++i) {
@@ -211,13 +254,13 @@ void Packet::displaySerialized(const char* serialized)
   std::cout << std::dec << std::setfill(' ') << "" << std::endl; // reset formatting
 }
 
-const char* Packet::serialize() const {
+size_t Packet::serialize(char* buffer) const {
   size_t offset = 0;
   // Write the message type (1 byte)
-  serialized_buffer[offset++] = static_cast<char>(m_type);
+  buffer[offset++] = static_cast<char>(m_type);
   
   // Write the number of messages (1 byte)
-  serialized_buffer[offset++] = static_cast<char>(nb_mes);
+  buffer[offset++] = static_cast<char>(nb_mes);
   
   if (m_type == MES) 
   {
@@ -226,66 +269,58 @@ const char* Packet::serialize() const {
     {
       // Sequence number
       pkt_seq_t pkt_network = convertToNetwork(data.seqs[i]);
-      std::memcpy(&serialized_buffer[offset], &pkt_network, sizeof(pkt_network));
+      std::memcpy(buffer + offset, &pkt_network, sizeof(pkt_network));
       offset += sizeof(pkt_network);
       
       // serialize message
-      data.msgs[i]->serializeTo(serialized_buffer.data(), offset);
+      data.msgs[i]->serializeTo(buffer, offset);
     }
   }
   else
   {
     const auto& data = std::get<1>(payload);
-    for (const auto& pkt : data) {
+    for (size_t i = 0; i < nb_mes; i++)
+    {
       // Sequence number
-      pkt_seq_t pkt_network = convertToNetwork(pkt);
-      std::memcpy(&serialized_buffer[offset], &pkt_network, sizeof(pkt_network));
+      pkt_seq_t pkt_network = convertToNetwork(data[i]);
+      std::memcpy(buffer + offset, &pkt_network, sizeof(pkt_network));
       offset += sizeof(pkt_network);
     }
   }
 
-  return serialized_buffer.data();
+  return offset;
 }
 
-Packet Packet::deserialize(const char* buffer) {  
+Packet Packet::deserialize(const char* buffer, size_t len) {  
   size_t offset = 0;
   
   // STEP 1: Read type (1 byte)
-  MessageType type = static_cast<MessageType>(buffer[offset++]);
+  MessageType type = readField<MessageType>(buffer, len, offset);
+  if (type != MES && type != ACK) throw std::runtime_error("Unknown packet type in deserialization");
   
   // STEP 2: Read nb_mes (1 byte)
-  uint8_t nb = static_cast<uint8_t>(buffer[offset++]);
+  uint8_t nb = readField<uint8_t>(buffer, len, offset);
   if (nb > MAX_MESSAGES_PER_PACKET) throw std::runtime_error("Maximum message per packet bound exceeded in deserialization");
   
   if (type == MessageType::MES) 
   {
-    std::array<pkt_seq_t, MAX_MESSAGES_PER_PACKET> seqs;
+    std::array<pkt_seq_t, MAX_MESSAGES_PER_PACKET> seqs{}; // unused slots zeroed
     std::array<std::shared_ptr<const Message>, MAX_MESSAGES_PER_PACKET> msgs;
 
     for (uint8_t i = 0; i < nb; ++i) {
-      pkt_seq_t pkt;
-      
-      // Read and convert from network byte order
-      pkt_seq_t pkt_network;
-      std::memcpy(&pkt_network, buffer + offset, sizeof(pkt_network));
-      offset += sizeof(pkt_network);
-
-      seqs[i] = convertFromNetwork(pkt_network);
-      msgs[i] = std::make_shared<Message>(Message::deserialize(buffer, offset));
+      seqs[i] = readField<pkt_seq_t>(buffer, len, offset);
+      msgs[i] = std::make_shared<Message>(Message::deserialize(buffer, len, offset));
     }
 
     return Packet(MES, nb, seqs, msgs);
   } 
   else
   {
-    std::array<pkt_seq_t, MAX_MESSAGES_PER_PACKET> seqs;
+    std::array<pkt_seq_t, MAX_MESSAGES_PER_PACKET> seqs{}; // unused slots zeroed
 
     for (uint8_t i = 0; i < nb; ++i) {
-      pkt_seq_t seq_network;
-      std::memcpy(&seq_network, buffer + offset, sizeof(seq_network));
-      offset += sizeof(seq_network);
-      seqs[i] = convertFromNetwork(seq_network);
+      seqs[i] = readField<pkt_seq_t>(buffer, len, offset);
     }
     return Packet(ACK, nb, seqs);
   }
-}
+}
\ No newline at end of file
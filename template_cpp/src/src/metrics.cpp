@@ -0,0 +1,84 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+
+// ===================== Histogram start ===================== //
+void Histogram::record(uint64_t value)
+{
+  buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+
+  uint64_t current = max_.load(std::memory_order_relaxed);
+  while (current < value && !max_.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+void Histogram::add(const Histogram& other)
+{
+  for (size_t i = 0; i < nb_buckets; i++) {
+    buckets[i].fetch_add(other.buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  uint64_t value = other.max();
+  uint64_t current = max_.load(std::memory_order_relaxed);
+  while (current < value && !max_.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+uint64_t Histogram::count() const
+{
+  uint64_t total = 0;
+  for (const auto &bucket: buckets) total += bucket.load(std::memory_order_relaxed);
+  return total;
+}
+
+uint64_t Histogram::percentile(double q) const
+{
+  uint64_t total = count();
+  if (total == 0) return 0;
+
+  // Rank of the quantile (1-based), clamped to the recorded values
+  uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total) + 0.5);
+  rank = std::max<uint64_t>(1, std::min(rank, total));
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < nb_buckets; i++) {
+    seen += buckets[i].load(std::memory_order_relaxed);
+    if (seen >= rank) return std::min(bucketUpperBound(i), max());
+  }
+  return max();
+}
+
+void Histogram::writeSummary(std::ostream& os, const std::string& name) const
+{
+  os << name << ".count " << count() << "\n"
+     << name << ".p50 " << percentile(0.5) << "\n"
+     << name << ".p99 " << percentile(0.99) << "\n"
+     << name << ".p999 " << percentile(0.999) << "\n"
+     << name << ".max " << max() << "\n";
+}
+
+void Histogram::writeDistribution(std::ostream& os, const std::string& name) const
+{
+  for (size_t i = 0; i < nb_buckets; i++) {
+    uint64_t n = buckets[i].load(std::memory_order_relaxed);
+    if (n > 0) os << name << "." << bucketUpperBound(i) << " " << n << "\n";
+  }
+}
+
+size_t Histogram::bucketOf(uint64_t value)
+{
+  if (value < 2 * sub_count) return static_cast<size_t>(value);
+
+  // Keep the sub_bits + 1 most significant bits: top is in [sub_count, 2 * sub_count)
+  unsigned shift = static_cast<unsigned>(64 - __builtin_clzll(value)) - (sub_bits + 1);
+  size_t top = static_cast<size_t>(value >> shift);
+  return (shift + 1) * sub_count + (top - sub_count);
+}
+
+uint64_t Histogram::bucketUpperBound(size_t bucket)
+{
+  if (bucket < 2 * sub_count) return bucket;
+
+  unsigned shift = static_cast<unsigned>(bucket / sub_count - 1);
+  uint64_t top = bucket % sub_count + sub_count;
+  return ((top + 1) << shift) - 1;
+}
+// ===================== Histogram end ===================== //
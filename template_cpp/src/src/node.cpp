@@ -1,8 +1,13 @@
 #include "node.hpp"
+#include "probes.hpp"
 
-Node::Node(std::vector<Parser::Host> nodes, proc_id_t id, std::string outputPath, uint32_t ds)
+Node::Node(std::vector<Parser::Host> nodes, proc_id_t id, std::string outputPath, uint32_t ds, std::unique_ptr<Transport> transport,
+           Tunables tunables, Clock clock)
   : id(id), 
+    tunables(tunables),
+    clock(std::move(clock)),
     logger(std::make_unique<Logger>(outputPath)), 
+    transport(std::move(transport)),
     nb_nodes(nodes.size()),
     lattice_agreement(nodes.size(), ds, this)
 {
@@ -12,24 +17,12 @@ Node::Node(std::vector<Parser::Host> nodes, proc_id_t id, std::string outputPath
   // Extract this node's information
   Parser::Host node = nodes[id - 1];
 
-  // Create IPv6 UDP socket 
-  node_socket = socket(AF_INET, SOCK_DGRAM, 0);
-  if (node_socket < 0) {
-    std::ostringstream os;
-    os << "Failed to create socket for host " << node.ipReadable() << ":" << node.portReadable();
-    throw std::runtime_error(os.str());
-  }
-
   // Set up receiver address
   node_addr = setupIpAddress(node);
 
-  // Bind the socket with the recevier address
-  if (bind(node_socket, reinterpret_cast<const sockaddr*>(&node_addr), sizeof(node_addr)) < 0) {
-    std::ostringstream os;
-    os << "Failed to bind socket to address " << node.ipReadable() << ":" << node.portReadable() << "" << std::endl;
-    throw std::runtime_error(os.str());
-  } else {
-    // std::cout << "Socket bound to address " << node.ipReadable() << ":" << node.portReadable() << "" << std::endl;
+  // Bind a UDP socket to the receiver address unless a transport was supplied
+  if (!this->transport) {
+    this->transport = std::make_unique<UdpTransport>(node_addr);
   }
 
   // Create sender id map
@@ -41,9 +34,27 @@ Node::Node(std::vector<Parser::Host> nodes, proc_id_t id, std::string outputPath
       others_id[addr_hashable] = n.id;
 
       // Create network links
-      links[addr_hashable] = std::make_unique<PerfectLink>(node_socket, node_addr, n_addr);
+      links[addr_hashable] = std::make_unique<PerfectLink>(*this->transport, node_addr, n_addr, n.id, this->tunables);
+      send_links.push_back(links[addr_hashable].get());
     }
   }
+
+  // Partition links over the sender threads (round robin until the first rebalance)
+  nb_senders = std::max<size_t>(1, std::min<size_t>(SENDER_THREADS, send_links.size()));
+  link_owner = std::vector<std::atomic<uint32_t>>(send_links.size());
+  for (size_t i = 0; i < send_links.size(); i++) {
+    link_owner[i].store(static_cast<uint32_t>(i % nb_senders));
+  }
+
+  // One listener per receive queue of the transport
+  for (size_t i = 0; i < this->transport->receiveQueues(); i++) {
+    listeners.push_back(std::make_unique<Listener>());
+  }
+
+  // Create lattice agreement workers
+  for (size_t i = 0; i < LA_WORKER_THREADS; i++) {
+    la_workers.push_back(std::make_unique<Worker>());
+  }
 }
 
 Node::~Node()
@@ -61,25 +72,51 @@ void Node::start()
   }
 
   runFlag.store(true);
+  start_time = std::chrono::steady_clock::now();
 
   // start worker threads bound to this instance
-  sender_thread = std::thread(&Node::send, this);
-  listener_thread = std::thread(&Node::listen, this);
+  for (size_t i = 0; i < la_workers.size(); i++) {
+    la_workers[i]->thread = std::thread(&Node::processMessages, this, i);
+    place(la_workers[i]->thread, CpuAffinity::Role::WORKER, i);
+  }
+  for (size_t i = 0; i < nb_senders; i++) {
+    sender_threads.emplace_back(&Node::send, this, i);
+    place(sender_threads.back(), CpuAffinity::Role::SENDER, i);
+  }
+  for (size_t i = 0; i < listeners.size(); i++) {
+    listeners[i]->thread = std::thread(&Node::listen, this, i);
+    place(listeners[i]->thread, CpuAffinity::Role::LISTENER, i);
+  }
   logger_thread = std::thread(&Node::log, this);
+  place(logger_thread, CpuAffinity::Role::LOGGER, 0);
   lattice_agreement_processor_thread = std::thread(&Node::processLatticeAgreement, this);
+  place(lattice_agreement_processor_thread, CpuAffinity::Role::PROPOSER, 0);
+}
+
+void Node::place(std::thread& thread, CpuAffinity::Role role, size_t index)
+{
+  if (!affinity.pin(thread, role, index)) {
+    std::cout << "Failed to pin " << CpuAffinity::name(role) << " thread " << index << ", left to the scheduler\n";
+  }
 }
 
 void Node::cleanup() 
 {
-  close(node_socket);
+  transport->close();
   logger->cleanup();
+  if (trace) trace->flush();
+}
+
+void Node::traceTo(std::unique_ptr<TraceWriter> writer)
+{
+  trace = std::move(writer);
+  for (auto &[addr, link]: links) link->setTrace(trace.get());
 }
 
 void Node::flushToOutput() 
 {
   // Flush output stream to ensure all received messages are logged.
   logger->write();
-  logger->flush();
 }
 
 void Node::terminate()
@@ -90,28 +127,203 @@ void Node::terminate()
   // flush standard output to debug
   // std::cout << std::endl;
 
-  // unblock recvfrom if it's blocked
-  ::shutdown(node_socket, SHUT_RDWR);
+  // unblock the listeners if they are blocked in receive
+  transport->shutdown();
 
   // terminate lattice agreement if it is blocked
   lattice_agreement.terminate();
 
+  // wake up the logger thread
+  logger->wakeUp();
+
   // join threads (wait for loops to exit)
-  if (sender_thread.joinable()) sender_thread.join();
-  // std::cout << "Sender thread joined" << std::endl;
-  if (listener_thread.joinable()) listener_thread.join();
+  for (auto &sender_thread: sender_threads) {
+    if (sender_thread.joinable()) sender_thread.join();
+  }
+  // std::cout << "Sender threads joined" << std::endl;
+  for (auto &listener: listeners) {
+    if (listener->thread.joinable()) listener->thread.join();
+  }
   // std::cout << "Listener thread joined" << std::endl;
   if (logger_thread.joinable()) logger_thread.join();
   // std::cout << "Logger thread joined" << std::endl;
   if (lattice_agreement_processor_thread.joinable()) lattice_agreement_processor_thread.join();
   // std::cout << "lattice_agreement_processor_thread thread joined" << std::endl;
+  for (auto &worker: la_workers) {
+    if (worker->thread.joinable()) worker->thread.join();
+  }
 }
 
-void Node::propose(std::set<proposal_t>&& proposal)
+prop_nb_t Node::propose(std::set<proposal_t>&& proposal, DecisionCallback on_decide)
 {
+  std::lock_guard<Mutex> lock(propose_mutex);
+  if (trace) trace->record(proposal);
   next_la_instance_nb++;
-  proposal_queue.push_back(std::make_pair(next_la_instance_nb, std::move(proposal)));
-  std::this_thread::sleep_for(std::chrono::milliseconds(PROPOSAL_TIMEOUT_MS));
+  proposal_queue.push_back(Proposal{next_la_instance_nb, std::move(proposal), std::move(on_decide), clock()});
+  return next_la_instance_nb;
+}
+
+std::future<std::set<proposal_t>> Node::proposeAsync(std::set<proposal_t>&& proposal)
+{
+  auto promise = std::make_shared<std::promise<std::set<proposal_t>>>();
+  auto future = promise->get_future();
+  propose(std::move(proposal), [promise](prop_nb_t, const std::set<proposal_t>& decision) {
+    promise->set_value(decision);
+  });
+  return future;
+}
+
+prop_nb_t Node::proposeMany(std::vector<std::set<proposal_t>>&& proposals, DecisionCallback on_decide)
+{
+  std::lock_guard<Mutex> lock(propose_mutex);
+  prop_nb_t first = next_la_instance_nb + 1;
+
+  std::vector<Proposal> batch;
+  batch.reserve(proposals.size());
+  for (auto &proposal: proposals) {
+    if (trace) trace->record(proposal);
+    next_la_instance_nb++;
+    batch.push_back(Proposal{next_la_instance_nb, std::move(proposal), on_decide, clock()});
+  }
+  proposal_queue.push_back_all(std::move(batch));
+  return first;
+}
+
+prop_nb_t Node::proposeMany(std::shared_ptr<const ProposalArena> arena, DecisionCallback on_decide)
+{
+  std::lock_guard<Mutex> lock(propose_mutex);
+  prop_nb_t first = next_la_instance_nb + 1;
+
+  std::vector<Proposal> batch;
+  batch.reserve(arena->size());
+  for (size_t i = 0; i < arena->size(); i++) {
+    if (trace) trace->record(arena->begin(i), arena->count(i));
+    next_la_instance_nb++;
+    batch.push_back(Proposal{next_la_instance_nb, {}, on_decide, clock()});
+    batch.back().arena = arena;
+    batch.back().arena_index = i;
+  }
+  proposal_queue.push_back_all(std::move(batch));
+  return first;
+}
+
+bool Node::waitForProposalCapacity(std::chrono::milliseconds timeout)
+{
+  return proposal_queue.wait_size_below(PROPOSAL_QUEUE_LIMIT, timeout);
+}
+
+std::vector<Node::WorkerStats> Node::workerStats() const
+{
+  double elapsed_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - start_time).count());
+
+  std::vector<WorkerStats> stats;
+  for (const auto &worker: la_workers) {
+    double busy_ns = static_cast<double>(worker->busy_ns.load(std::memory_order_relaxed));
+    stats.push_back({
+      worker->queue.size(),
+      worker->processed.load(std::memory_order_relaxed),
+      elapsed_ns > 0 ? busy_ns / elapsed_ns : 0.0
+    });
+  }
+  return stats;
+}
+
+void Node::displayWorkerStats() const
+{
+  auto stats = workerStats();
+  for (size_t i = 0; i < stats.size(); i++) {
+    std::cout << "LA worker " << i << ": queue depth " << stats[i].queue_depth 
+              << ", processed " << stats[i].processed 
+              << ", utilisation " << stats[i].utilisation * 100 << "%\n";
+  }
+}
+
+void Node::writeMetrics(const std::string& path)
+{
+  std::ostringstream os;
+  os << "node.uptime_ms " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count() << "\n"
+     << "node.recv_calls " << metrics.recv_calls.load() << "\n"
+     << "node.bytes_received " << metrics.bytes_received.load() << "\n"
+     << "node.duplicates_dropped " << metrics.duplicates_dropped.load() << "\n"
+     << "node.decode_errors " << metrics.decode_errors.load() << "\n"
+     << "node.unknown_senders " << metrics.unknown_senders.load() << "\n"
+     << "node.receive_drops " << transport->receiveDrops() << "\n"
+     << "node.receive_queue_fill " << transport->receiveQueueFill() << "\n"
+     << "node.proposal_queue_depth " << proposal_queue.size() << "\n";
+  transport->writeMetrics(os);
+
+  // Links by peer id
+  std::vector<std::pair<proc_id_t, const PerfectLink *>> peers;
+  for (const auto &[addr, peer_id]: others_id) peers.emplace_back(peer_id, links.at(addr).get());
+  std::sort(peers.begin(), peers.end());
+  for (const auto &[peer_id, link]: peers) {
+    link->writeMetrics(os, "link." + std::to_string(peer_id));
+  }
+
+  lattice_agreement.writeMetrics(os);
+
+  auto stats = workerStats();
+  for (size_t i = 0; i < stats.size(); i++) {
+    os << "worker." << i << ".queue_depth " << stats[i].queue_depth << "\n"
+       << "worker." << i << ".processed " << stats[i].processed << "\n"
+       << "worker." << i << ".utilisation " << stats[i].utilisation << "\n";
+  }
+
+  for (size_t i = 0; i < listeners.size(); i++) {
+    os << "listener." << i << ".recv_calls " << listeners[i]->recv_calls.load() << "\n";
+  }
+
+  // Write next to the target and rename over it
+  std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::trunc);
+    file << os.str();
+    if (!file) {
+      std::cout << "Failed to write metrics to " << tmp_path << "\n";
+      return;
+    }
+  }
+  std::rename(tmp_path.c_str(), path.c_str());
+}
+
+void Node::sendPending()
+{
+  if (!step_batch) step_batch = std::make_unique<SendBatch>(*transport);
+  for (PerfectLink *link: send_links) {
+    link->sendPaced(*step_batch, clock());
+  }
+  step_batch->flush();
+}
+
+void Node::receiveDatagram(const char *data, size_t len, const sockaddr_in &sender)
+{
+  metrics.recv_calls.add();
+  metrics.bytes_received.add(len);
+  handleDatagram(data, len, sender, true);
+}
+
+void Node::stepProposals()
+{
+  while (true) {
+    // Complete the current proposal once decided
+    if (current_proposal) {
+      auto decision = lattice_agreement.pollDecision(current_proposal->instance);
+      if (!decision) return;
+
+      lattice_agreement.metrics.end_to_end_us.record(microsecondsBetween(current_proposal->queued_at, clock()));
+      Proposal done = std::move(*current_proposal);
+      current_proposal.reset();
+      if (done.on_decide) done.on_decide(done.instance, *decision);
+    }
+
+    // Propose the next one (proposals are sequential, see processLatticeAgreement)
+    auto next = proposal_queue.pop_k_front(1);
+    if (next.empty()) return;
+    current_proposal = std::move(next.front());
+    lattice_agreement.metrics.queue_wait_us.record(microsecondsBetween(current_proposal->queued_at, clock()));
+    lattice_agreement.propose(current_proposal->instance, current_proposal->takeValues());
+  }
 }
 
 // Private methods:
@@ -125,7 +337,9 @@ void Node::broadcast(std::shared_ptr<Message> msg)
   {
     pair.second->enqueueMessage(msg);
   }
-  std::this_thread::sleep_for(std::chrono::milliseconds(BROADCAST_COOLDOWN_MS));
+  if (tunables.broadcast_cooldown_ms > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(tunables.broadcast_cooldown_ms));
+  }
 }
 
 void Node::sendTo(std::shared_ptr<Message> msg, std::string dest)
@@ -134,39 +348,91 @@ void Node::sendTo(std::shared_ptr<Message> msg, std::string dest)
   // msg.get()->displayMessage();
   // std::cout << " to " << dest << "\n";
   
-  links[dest]->enqueueMessage(msg);
+  links.at(dest)->enqueueMessage(msg);
 }
 
-void Node::send()
+void Node::send(size_t sender)
 {
+  // Each sender thread owns its batch (serialization buffers and syscall batch)
+  SendBatch batch(*transport);
+  auto last_rebalance = std::chrono::steady_clock::now();
+  auto last_feedback = last_rebalance;
+  uint64_t last_drops = transport->receiveDrops();
+
   while (runFlag.load())
   {
     // std::cout << "Sending messages" << std::endl;
-    // Try sending messages from all sender links
-    for (auto &pair: links) {
+    // Try sending messages from the sender links owned by this thread, as their pacing allows
+    auto now = std::chrono::steady_clock::now();
+    auto wake_at = now + std::chrono::microseconds(PACING_IDLE_WAIT_US);
+    for (size_t i = 0; i < send_links.size(); i++) {
+      if (link_owner[i].load(std::memory_order_relaxed) != sender) continue;
+
       // Send messages enqueued on each sender link
-      pair.second->send();
+      send_links[i]->sendPaced(batch, now);
+      if (send_links[i]->backlog() > 0) wake_at = std::min(wake_at, send_links[i]->nextRound());
+    }
+    batch.flush();
+
+    // Receive pressure on this node (kernel drops or filling queues) slows its links down
+    if (now - last_feedback >= std::chrono::milliseconds(PACING_FEEDBACK_MS)) {
+      uint64_t drops = transport->receiveDrops();
+      if (drops > last_drops || transport->receiveQueueFill() > PACING_QUEUE_HIGH) {
+        for (size_t i = 0; i < send_links.size(); i++) {
+          if (link_owner[i].load(std::memory_order_relaxed) == sender) send_links[i]->slowDown();
+        }
+      }
+      last_drops = drops;
+      last_feedback = now;
     }
 
-    // Sleep for a short duration to avoid busy-waiting (waiting for messages to be enqueued)
-    // For optimal performance, could try to design a congestion control algorithm to adjust sending rate based on network conditions
-    std::this_thread::sleep_for(std::chrono::milliseconds(SEND_TIMEOUT_MS));
+    // The first sender periodically rebalances the links
+    if (sender == 0 && now - last_rebalance > std::chrono::milliseconds(SENDER_REBALANCE_MS)) {
+      rebalanceSenders();
+      last_rebalance = now;
+    }
+
+    // Sleep until the next paced round (or for a short duration when idle, waiting for messages to be enqueued)
+    std::this_thread::sleep_until(std::max(wake_at, now + std::chrono::milliseconds(tunables.send_timeout_ms)));
+  }
+}
+
+void Node::rebalanceSenders()
+{
+  if (nb_senders == 1) return;
+
+  // Longest backlog first onto the least loaded sender (every link weighs at least 1 so idle links are spread too)
+  std::vector<std::pair<size_t, size_t>> backlogs; // (backlog, link index)
+  for (size_t i = 0; i < send_links.size(); i++) {
+    backlogs.emplace_back(send_links[i]->backlog() + 1, i);
+  }
+  std::sort(backlogs.begin(), backlogs.end(), std::greater<std::pair<size_t, size_t>>());
+
+  std::vector<size_t> load(nb_senders, 0);
+  for (const auto &[backlog, i]: backlogs) {
+    size_t sender = static_cast<size_t>(std::min_element(load.begin(), load.end()) - load.begin());
+    load[sender] += backlog;
+    link_owner[i].store(static_cast<uint32_t>(sender), std::memory_order_relaxed);
   }
 }
 
-void Node::listen()
+void Node::listen(size_t queue)
 {
+  // Receive buffer owned by the listener thread, reused for every packet (one byte larger than a packet, so that 
+  // oversized datagrams are not silently truncated to a packet)
+  std::vector<char> buffer(Packet::max_serialized_size + 1);
+
   // Listen while the run flag is set
   while (runFlag.load())
   {
     // Prepare buffer to receive message
     // std::cout << "Listening for message" << std::endl;
-    std::array<char, Packet::max_serialized_size> buffer;
     sockaddr_in sender_addr;
-    socklen_t addr_len = sizeof(sender_addr);
   
     // Sleeps until message received.
-    ssize_t bytes_received = recvfrom(node_socket, buffer.data(), Packet::max_serialized_size, 0, reinterpret_cast<sockaddr *>(&sender_addr), &addr_len);
+    ssize_t bytes_received = transport->receive(queue, buffer.data(), buffer.size(), sender_addr);
+    metrics.recv_calls.add();
+    listeners[queue]->recv_calls.add();
     if (bytes_received < 0) {
       std::cout << "recvfrom failed\n";
       continue;
@@ -176,30 +442,90 @@ void Node::listen()
       // std::cout << "Socket shutdown, stopping network packet processing." << std::endl;
       return; // Socket has been shut down
     }
+    metrics.bytes_received.add(static_cast<uint64_t>(bytes_received));
+    if (trace) {
+      auto sender = others_id.find(ipAddressToString(sender_addr));
+      trace->record(TraceKind::RECEIVED, sender != others_id.end() ? sender->second : 0, buffer.data(), static_cast<size_t>(bytes_received));
+    }
 
-    // Decode message
-    std::string sender_ip_and_port = ipAddressToString(sender_addr);
-    // std::cout << "message received from " << sender_ip_and_port << "" << std::endl;
+    handleDatagram(buffer.data(), static_cast<size_t>(bytes_received), sender_addr, false);
+  }
+}
 
-    // Packet::displaySerialized(buffer.data());
-    Packet pkt = Packet::deserialize(buffer.data());
-    // pkt.displayPacket();
-  
+void Node::handleDatagram(const char *data, size_t len, const sockaddr_in &sender_addr, bool process_inline)
+{
+  // Decode message
+  std::string sender_ip_and_port = ipAddressToString(sender_addr);
+  // std::cout << "message received from " << sender_ip_and_port << "" << std::endl;
+
+  // Drop packets from unknown senders
+  auto link = links.find(sender_ip_and_port);
+  if (link == links.end()) {
+    metrics.unknown_senders.add();
+    return;
+  }
+
+  // Packet::displaySerialized(data, len);
+  // Malformed packets are dropped and counted: oversized datagrams, and truncated packets or unknown packet and 
+  // message types (rejected by Packet::deserialize)
+  std::optional<Packet> decoded;
+  std::array<bool, MAX_MESSAGES_PER_PACKET> received_msgs;
+  try {
+    if (len > Packet::max_serialized_size) throw std::runtime_error("Oversized datagram");
+    decoded.emplace(Packet::deserialize(data, len));
     // Process message through perfect link -> extract new received messages
-    std::array<bool, MAX_MESSAGES_PER_PACKET> received_msgs = links[sender_ip_and_port]->receive(pkt);
-
-    // if an ACK was received, so skip delivery processing
-    if (pkt.getType() == MessageType::ACK) continue;
-
-    std::array<std::shared_ptr<const Message>, MAX_MESSAGES_PER_PACKET> msgs = pkt.getMessages();
-    // Deliver message
-    for (size_t i = 0; i < pkt.getNbMes(); i++) {
-      // If message was already received, SKIP
-      // std::cout << "received_msgs[" << i << "] = " << received_msgs[i] << "\n";
-      if (!received_msgs[i]) continue;
-            
-      lattice_agreement.processMessage(msgs[i], sender_ip_and_port);
+    received_msgs = link->second->receive(*decoded);
+  } catch (const std::exception&) {
+    metrics.decode_errors.add();
+    return;
+  }
+  const Packet &pkt = *decoded;
+  DA_PROBE4(packet_received, link->second->peerId(), pkt.getType(), pkt.getSeqs()[0], pkt.getNbMes());
+  // pkt.displayPacket();
+
+  // if an ACK was received, so skip delivery processing
+  if (pkt.getType() == MessageType::ACK) return;
+
+  std::array<std::shared_ptr<const Message>, MAX_MESSAGES_PER_PACKET> msgs = pkt.getMessages();
+  // Deliver message
+  for (size_t i = 0; i < pkt.getNbMes(); i++) {
+    // If message was already received, SKIP
+    // std::cout << "received_msgs[" << i << "] = " << received_msgs[i] << "\n";
+    if (!received_msgs[i]) {
+      metrics.duplicates_dropped.add();
+      DA_PROBE4(message_duplicate, link->second->peerId(), pkt.getSeqs()[i], msgs[i]->instance, msgs[i]->round);
+      continue;
     }
+
+    if (process_inline) lattice_agreement.processMessage(msgs[i], sender_ip_and_port);
+    else dispatch(msgs[i], sender_ip_and_port);
+  }
+}
+
+void Node::dispatch(std::shared_ptr<const Message> msg, const std::string& sender_ip_and_port)
+{
+  la_workers[msg->instance % la_workers.size()]->queue.push_back(std::make_pair(msg, sender_ip_and_port));
+}
+
+void Node::processMessages(size_t worker)
+{
+  Worker &w = *la_workers[worker];
+
+  // Process while the run flag is set
+  while (runFlag.load())
+  {
+    // Sleeps until messages are dispatched to this worker (wakes up periodically to check the run flag)
+    auto batch = w.queue.wait_pop_k_front(LA_WORKER_BATCH, std::chrono::milliseconds(LA_WORKER_WAIT_MS));
+    if (batch.empty()) continue;
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &[msg, sender_ip_and_port]: batch) {
+      lattice_agreement.processMessage(msg, sender_ip_and_port);
+    }
+    auto duration = std::chrono::steady_clock::now() - start;
+
+    w.busy_ns.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()), std::memory_order_relaxed);
+    w.processed.fetch_add(batch.size(), std::memory_order_relaxed);
   }
 }
 
@@ -207,10 +533,10 @@ void Node::log() {
   // Listen while the run flag is set
   while (runFlag.load())
   {
-    // Periodically write log entries to file
+    // Write log entries to file periodically, or earlier once enough are buffered
     // std::cout << "Logging" << std::endl;
+    logger->waitForFlush(std::chrono::milliseconds(tunables.log_timeout_ms));
     logger->write();
-    std::this_thread::sleep_for(std::chrono::milliseconds(LOG_TIMEOUT));
   }
 }
 
@@ -219,16 +545,18 @@ void Node::processLatticeAgreement()
   // Process while the run flag is set
   while (runFlag.load())
   {
-    // Check queue for proposals, if empty, SLEEP and CONTINUE
-    if (proposal_queue.empty()) continue;
-
-    // Pop the first proposal from queue.
-    auto [instance_id, proposal] = proposal_queue.pop_front();
+    // Wait for the next proposal (bounded so that the run flag is checked)
+    auto next = proposal_queue.wait_pop_k_front(1, std::chrono::milliseconds(LA_WORKER_WAIT_MS));
+    if (next.empty()) continue;
+    Proposal &proposal = next.front();
+    lattice_agreement.metrics.queue_wait_us.record(microsecondsBetween(proposal.queued_at, clock()));
 
     // Propose this proposal to lattice agreement instance
-    lattice_agreement.propose(instance_id, proposal);
+    lattice_agreement.propose(proposal.instance, proposal.takeValues());
 
     // Wait for lattice_agreement instance to decide
-    lattice_agreement.waitUntilDecidedOrTerminated(instance_id);
+    auto decision = lattice_agreement.waitUntilDecidedOrTerminated(proposal.instance);
+    if (decision) lattice_agreement.metrics.end_to_end_us.record(microsecondsBetween(proposal.queued_at, clock()));
+    if (decision && proposal.on_decide) proposal.on_decide(proposal.instance, *decision);
   }
 }
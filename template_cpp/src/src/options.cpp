@@ -0,0 +1,105 @@
+#include "options.hpp"
+
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// Parses a socket buffer size in bytes, with an optional k or m suffix
+int parseBufferSize(const std::string &arg, const std::string &value)
+{
+  unsigned long long bytes = 0;
+  size_t end = 0;
+  try {
+    bytes = std::stoull(value, &end);
+  } catch (const std::exception&) {
+    end = 0;
+  }
+  std::string suffix = end > 0 ? value.substr(end) : "";
+  if (suffix == "k" || suffix == "K") bytes <<= 10;
+  else if (suffix == "m" || suffix == "M") bytes <<= 20;
+  else if (!suffix.empty()) end = 0;
+
+  if (end == 0 || bytes == 0 || bytes > static_cast<unsigned long long>(std::numeric_limits<int>::max() / 2)) {
+    throw std::invalid_argument("Invalid size " + value + " for " + arg);
+  }
+  return static_cast<int>(bytes);
+}
+
+} // namespace
+
+RuntimeOptions RuntimeOptions::parse(int argc, char const *const *argv, int first)
+{
+  RuntimeOptions options;
+  for (int i = first; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) throw std::invalid_argument("Missing value for option " + arg);
+    std::string value = argv[++i];
+
+    if (arg == "--transport") {
+      if (value == "udp") options.transport = TransportKind::UDP;
+      else if (value == "shm") options.transport = TransportKind::SHM;
+      else throw std::invalid_argument("Unknown transport " + value + " (expected udp or shm)");
+    }
+    else if (arg == "--listeners") {
+      unsigned long listeners = 0;
+      try {
+        listeners = std::stoul(value);
+      } catch (const std::exception&) {}
+      if (listeners == 0 || listeners > 64) throw std::invalid_argument("Invalid number of listeners " + value + " (expected 1 to 64)");
+      options.listeners = listeners;
+    }
+    else if (arg == "--steering") {
+      if (value == "hash") options.steering = Steering::HASH;
+      else if (value == "source") options.steering = Steering::SOURCE;
+      else throw std::invalid_argument("Unknown steering " + value + " (expected hash or source)");
+    }
+    else if (arg == "--rcvbuf") {
+      options.receive_buffer = parseBufferSize(arg, value);
+    }
+    else if (arg == "--sndbuf") {
+      options.send_buffer = parseBufferSize(arg, value);
+    }
+    else if (arg == "--offload") {
+      if (value == "on") options.offload = true;
+      else if (value == "off") options.offload = false;
+      else throw std::invalid_argument("Unknown offload " + value + " (expected on or off)");
+    }
+    else if (arg == "--io") {
+      if (value == "sockets") options.io = IoEngine::SOCKETS;
+      else if (value == "uring") options.io = IoEngine::URING;
+      else throw std::invalid_argument("Unknown io engine " + value + " (expected sockets or uring)");
+    }
+    else if (arg == "--trace") {
+      options.trace = value;
+    }
+    else if (arg == "--tuning") {
+      options.tunables.load(value);
+    }
+    else if (arg == "--tune") {
+      options.tunables.assign(value);
+    }
+    else if (arg == "--cpus") {
+      options.affinity.assign(value);
+    }
+    else if (arg == "--busy-poll") {
+      unsigned long us = 0;
+      size_t end = 0;
+      try {
+        us = std::stoul(value, &end);
+      } catch (const std::exception&) {
+        end = 0;
+      }
+      if (end == 0 || end != value.size() || us > 1000000) throw std::invalid_argument("Invalid busy poll " + value + " (expected 0 to 1000000 us)");
+      options.busy_poll_us = static_cast<int>(us);
+    }
+    else {
+      throw std::invalid_argument("Unknown option " + arg);
+    }
+  }
+
+  if (options.listeners > 1 && options.transport != TransportKind::UDP) {
+    throw std::invalid_argument("--listeners requires the udp transport");
+  }
+  return options;
+}
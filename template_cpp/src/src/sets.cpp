@@ -20,14 +20,14 @@ ConcurrentSet<T, Compare>::ConcurrentSet(bool bounded): bounded_(bounded), set_(
 template <typename T, typename Compare>
 bool ConcurrentSet<T, Compare>::empty()
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return set_.empty();
 }
 
 template <typename T, typename Compare>
 std::size_t ConcurrentSet<T, Compare>::size() const
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return set_.size();
 }
 
@@ -37,7 +37,7 @@ typename std::set<T, Compare>::iterator ConcurrentSet<T, Compare>::insert(const
 {
   // assert that this method is only used when the concurrent set is NOT bounded
   assert(!bounded_);
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
   
   // maximum efficiency insertion at the end of the set (we know m_seq is always increasing)
   auto result = set_.insert(set_.end(), value); 
@@ -49,7 +49,7 @@ template <typename T, typename Compare>
 void ConcurrentSet<T, Compare>::erase(const T &value)
 {
   // Lock the set while modifying it
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
   
   // Remove message from set (correctly delivered at target)
   set_.erase(value);
@@ -59,7 +59,7 @@ template <typename T, typename Compare>
 void ConcurrentSet<T, Compare>::erase(const std::vector<T> &values)
 {
   // Lock the set while modifying it
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
   
   // Remove message from set (correctly delivered at target)
   for (T value: values) {
@@ -72,7 +72,7 @@ std::vector<T> ConcurrentSet<T, Compare>::complete(ConcurrentDeque<T>& queue)
 {
   // assert that this method is only used when the concurrent set is bounded
   assert(bounded_);
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
 
   // get size of set
   size_t set_size = set_.size();
@@ -91,21 +91,21 @@ std::vector<T> ConcurrentSet<T, Compare>::complete(ConcurrentDeque<T>& queue)
 template <typename T, typename Compare>
 typename std::set<T, Compare>::iterator ConcurrentSet<T, Compare>::find(const T &value)
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return set_.find(value);
 }
 
 template <typename T, typename Compare>
 bool ConcurrentSet<T, Compare>::contains(const T &value)
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return set_.find(value) != set_.end();
 }
 
 template <typename T, typename Compare>
 std::vector<T> ConcurrentSet<T, Compare>::snapshot() const
 {
-  std::lock_guard<std::mutex> g(mutex_);
+  std::lock_guard<Mutex> g(mutex_);
   return std::vector<T>(set_.begin(), set_.end());
 }
 // ===================== ConcurrentSet end ===================== //
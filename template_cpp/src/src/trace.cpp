@@ -0,0 +1,138 @@
+#include "trace.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ===================== TraceWriter start ===================== //
+TraceWriter::TraceWriter(const std::string &path, const std::vector<Parser::Host> &hosts, proc_id_t id, uint32_t ds)
+  : start(std::chrono::steady_clock::now())
+{
+  fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) throw std::runtime_error("TraceWriter: failed to open trace file: " + path);
+  buffer.reserve(TRACE_BUFFER_BYTES);
+
+  TraceHeader header{};
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.id = static_cast<uint32_t>(id);
+  header.ds = ds;
+  header.nb_hosts = static_cast<uint32_t>(hosts.size());
+  buffer.insert(buffer.end(), reinterpret_cast<const char*>(&header), reinterpret_cast<const char*>(&header + 1));
+  for (const Parser::Host &host: hosts) {
+    TraceHost entry{static_cast<uint32_t>(host.id), host.ip, host.port, 0};
+    buffer.insert(buffer.end(), reinterpret_cast<const char*>(&entry), reinterpret_cast<const char*>(&entry + 1));
+  }
+}
+
+TraceWriter::~TraceWriter()
+{
+  flush();
+  ::close(fd);
+}
+
+char *TraceWriter::append(TraceKind kind, proc_id_t peer, size_t len)
+{
+  if (buffer.size() + sizeof(TraceRecord) + len > TRACE_BUFFER_BYTES) flushLocked();
+
+  TraceRecord record{};
+  record.time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+  record.len = static_cast<uint32_t>(len);
+  record.peer = static_cast<uint16_t>(peer);
+  record.kind = kind;
+
+  size_t offset = buffer.size();
+  buffer.resize(offset + sizeof(record) + len);
+  std::memcpy(buffer.data() + offset, &record, sizeof(record));
+  return buffer.data() + offset + sizeof(record);
+}
+
+void TraceWriter::record(TraceKind kind, proc_id_t peer, const char *data, size_t len)
+{
+  std::lock_guard<Mutex> lock(mutex);
+  std::memcpy(append(kind, peer, len), data, len);
+}
+
+void TraceWriter::record(TraceKind kind, proc_id_t peer, const Packet &packet)
+{
+  std::lock_guard<Mutex> lock(mutex);
+  packet.serialize(append(kind, peer, packet.serializedSize()));
+}
+
+void TraceWriter::record(const std::set<proposal_t> &proposal)
+{
+  std::lock_guard<Mutex> lock(mutex);
+  char *data = append(TraceKind::PROPOSED, 0, proposal.size() * sizeof(proposal_t));
+  for (proposal_t value: proposal) {
+    std::memcpy(data, &value, sizeof(value));
+    data += sizeof(value);
+  }
+}
+
+void TraceWriter::record(const proposal_t *values, size_t count)
+{
+  std::lock_guard<Mutex> lock(mutex);
+  std::memcpy(append(TraceKind::PROPOSED, 0, count * sizeof(proposal_t)), values, count * sizeof(proposal_t));
+}
+
+void TraceWriter::flush()
+{
+  std::lock_guard<Mutex> lock(mutex);
+  flushLocked();
+}
+
+void TraceWriter::flushLocked()
+{
+  size_t written = 0;
+  while (written < buffer.size()) {
+    ssize_t n = ::write(fd, buffer.data() + written, buffer.size() - written);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      break; // the trace is best effort: the rest of the buffer is dropped
+    }
+    written += static_cast<size_t>(n);
+  }
+  buffer.clear();
+}
+// ===================== TraceWriter end ===================== //
+
+// ===================== TraceReader start ===================== //
+TraceReader::TraceReader(const std::string &path)
+  : in(path, std::ios::binary)
+{
+  if (!in) throw std::runtime_error("TraceReader: failed to open trace file: " + path);
+
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in || std::memcmp(header.magic, TraceWriter::magic, sizeof(header.magic)) != 0) {
+    throw std::runtime_error("TraceReader: not a trace file: " + path);
+  }
+  if (header.version != TraceWriter::version) {
+    throw std::runtime_error("TraceReader: unsupported trace version " + std::to_string(header.version));
+  }
+
+  for (uint32_t i = 0; i < header.nb_hosts; i++) {
+    TraceHost entry;
+    in.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+    if (!in) throw std::runtime_error("TraceReader: truncated host list: " + path);
+    Parser::Host host;
+    host.id = entry.id;
+    host.ip = entry.ip;
+    host.port = entry.port;
+    hosts_.push_back(host);
+  }
+}
+
+bool TraceReader::next(TraceRecord &record, std::vector<char> &data)
+{
+  if (!in.read(reinterpret_cast<char*>(&record), sizeof(record))) return false;
+  if (record.kind != TraceKind::RECEIVED && record.kind != TraceKind::SENT && record.kind != TraceKind::PROPOSED) {
+    throw std::runtime_error("TraceReader: corrupt record (unknown kind)");
+  }
+  if (record.len > max_record_len) throw std::runtime_error("TraceReader: corrupt record (length " + std::to_string(record.len) + ")");
+  data.resize(record.len);
+  // A record cut by a killed writer ends the trace
+  return static_cast<bool>(in.read(data.data(), static_cast<std::streamsize>(record.len)));
+}
+// ===================== TraceReader end ===================== //
@@ -0,0 +1,847 @@
+#include "transport.hpp"
+#include "helper.hpp"
+#include "globals.hpp"
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <linux/filter.h>
+#include <linux/futex.h>
+#include <linux/sock_diag.h>
+#include <netinet/udp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ===================== UdpTransport start ===================== //
+namespace {
+
+// Sets a socket buffer size, beyond the sysctl limit (net.core.rmem_max/wmem_max) when privileged
+void setBufferSize(int socket_fd, int force_option, int option, int bytes, const char *name)
+{
+  if (bytes <= 0) return;
+  if (setsockopt(socket_fd, SOL_SOCKET, force_option, &bytes, sizeof(bytes)) == 0) return;
+  setsockopt(socket_fd, SOL_SOCKET, option, &bytes, sizeof(bytes));
+
+  // The kernel doubles the value for its bookkeeping
+  int actual = 0;
+  socklen_t len = sizeof(actual);
+  if (getsockopt(socket_fd, SOL_SOCKET, option, &actual, &len) == 0 && actual / 2 < bytes) {
+    std::cout << name << " capped at " << actual / 2 << " bytes (raise the sysctl limit or run with CAP_NET_ADMIN)\n";
+  }
+}
+
+// Spin-wait hint to the core (frees the pipeline for a sibling hyperthread)
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+} // namespace
+
+UdpTransport::UdpTransport(const sockaddr_in &addr, UdpConfig config)
+  : drops(std::max<size_t>(1, config.sockets))
+{
+  size_t nb_sockets = std::max<size_t>(1, config.sockets);
+  for (size_t i = 0; i < nb_sockets; i++) {
+    // Create IPv4 UDP socket 
+    int socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket_fd < 0) {
+      close();
+      std::ostringstream os;
+      os << "Failed to create socket for host " << ipAddressToString(addr);
+      throw std::runtime_error(os.str());
+    }
+    sockets.push_back(socket_fd);
+
+    setBufferSize(socket_fd, SO_RCVBUFFORCE, SO_RCVBUF, config.receive_buffer, "Receive buffer");
+    setBufferSize(socket_fd, SO_SNDBUFFORCE, SO_SNDBUF, config.send_buffer, "Send buffer");
+
+    // Count the datagrams dropped by the kernel (delivered as a control message with every datagram)
+    int enable = 1;
+    setsockopt(socket_fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+
+    // Share the port between the sockets
+    if (nb_sockets > 1 && setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+      close();
+      throw std::runtime_error("Failed to set SO_REUSEPORT: " + std::string(strerror(errno)));
+    }
+
+    // The program is attached to the first socket before it binds, so the group is steered as soon as it forms
+    if (i == 0 && nb_sockets > 1 && config.steer_by_source && !attachSteering(socket_fd, nb_sockets)) {
+      std::cout << "Failed to attach the steering program (errno: " << strerror(errno) << "), senders are spread by hash\n";
+    }
+
+    // Bind the socket with the receiver address
+    if (bind(socket_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+      close();
+      std::ostringstream os;
+      os << "Failed to bind socket to address " << ipAddressToString(addr);
+      throw std::runtime_error(os.str());
+    }
+  }
+
+  if (config.busy_poll_us > 0) {
+    busy_poll = true;
+    for (int socket_fd: sockets) {
+      busy_poll = busy_poll && setsockopt(socket_fd, SOL_SOCKET, SO_BUSY_POLL, &config.busy_poll_us, sizeof(config.busy_poll_us)) == 0;
+    }
+    if (!busy_poll) {
+      std::cout << "Failed to set SO_BUSY_POLL (errno: " << strerror(errno) << "), listeners block\n";
+    }
+  }
+
+  // Until the last socket is bound, the kernel spreads datagrams by hash over the sockets bound so far (and the
+  // program's index may exceed them). Drop what arrived meanwhile, so that no sender has datagrams queued on two
+  // sockets (its link state is only touched by one listener); the perfect links retransmit them.
+  if (nb_sockets > 1) {
+    for (int socket_fd: sockets) {
+      char discard;
+      while (recv(socket_fd, &discard, sizeof(discard), MSG_DONTWAIT) >= 0) {}
+    }
+  }
+
+  if (config.offload) {
+    // Kernels without UDP_SEGMENT (< 4.18) reject the option
+    int segment = 0;
+    socklen_t len = sizeof(segment);
+    segmentation.store(getsockopt(sockets[0], IPPROTO_UDP, UDP_SEGMENT, &segment, &len) == 0);
+
+    // Kernels without UDP_GRO (< 5.0) reject the option, the datagrams are then received one by one
+    int enable = 1;
+    gro = true;
+    for (int socket_fd: sockets) {
+      gro = gro && setsockopt(socket_fd, IPPROTO_UDP, UDP_GRO, &enable, sizeof(enable)) == 0;
+    }
+    if (gro) {
+      coalesced.resize(sockets.size());
+      for (auto &buffer: coalesced) buffer.data.resize(UINT16_MAX);
+    }
+  }
+}
+
+bool UdpTransport::attachSteering(int socket_fd, size_t nb_sockets)
+{
+  // The program returns the index of the socket in the group (bind order), computed as steeringQueue.
+  // Offsets relative to SKF_NET_OFF address the IP header (without options) followed by the UDP header.
+  std::array<sock_filter, 6> code = {{
+    { BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_NET_OFF + 12) },  // A = source address
+    { BPF_MISC | BPF_TAX, 0, 0, 0 },                                              // X = A
+    { BPF_LD | BPF_H | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_NET_OFF + 20) },  // A = source port
+    { BPF_ALU | BPF_XOR | BPF_X, 0, 0, 0 },                                       // A ^= X
+    { BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(nb_sockets) },       // A %= number of sockets
+    { BPF_RET | BPF_A, 0, 0, 0 },
+  }};
+  sock_fprog program{static_cast<unsigned short>(code.size()), code.data()};
+  return setsockopt(socket_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == 0;
+}
+
+size_t UdpTransport::steeringQueue(const sockaddr_in &sender, size_t nb_queues)
+{
+  // Loads of the program are in host byte order
+  return (ntohl(sender.sin_addr.s_addr) ^ ntohs(sender.sin_port)) % nb_queues;
+}
+
+UdpTransport::~UdpTransport()
+{
+  close();
+}
+
+void UdpTransport::send(const Datagram *datagrams, size_t count)
+{
+  if (sockets.empty()) return;
+
+  // Split the datagrams into runs sent by one sendmmsg entry each: consecutive datagrams to the same destination
+  // make one segmented buffer (as long as the segment size, the padded total and the segment count allow)
+  std::array<std::pair<size_t, size_t>, SEND_BATCH_SIZE> runs; // (first datagram, count)
+  size_t nb_runs = 0;
+  size_t nb_datagrams = 0;
+  bool segment = segmentation.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < count;) {
+    size_t end = i + 1;
+    size_t max_len = datagrams[i].len;
+    while (segment && end < count && max_len <= UDP_GSO_MAX_SEGMENT && end - i < std::min(UDP_GSO_MAX_SEGMENTS, SEND_BATCH_SIZE)) {
+      const Datagram &next = datagrams[end];
+      size_t next_max = std::max(max_len, next.len);
+      if (next.dest.sin_addr.s_addr != datagrams[i].dest.sin_addr.s_addr || next.dest.sin_port != datagrams[i].dest.sin_port
+          || next_max > UDP_GSO_MAX_SEGMENT || next_max * (end - i + 1) > UINT16_MAX - 64) break;
+      max_len = next_max;
+      end++;
+    }
+
+    // At most SEND_BATCH_SIZE runs and datagrams per sendmmsg
+    if (nb_runs == runs.size() || nb_datagrams + end - i > SEND_BATCH_SIZE) {
+      sendRuns(datagrams, runs, nb_runs);
+      nb_runs = 0;
+      nb_datagrams = 0;
+    }
+    runs[nb_runs++] = {i, end - i};
+    nb_datagrams += end - i;
+    i = end;
+  }
+  sendRuns(datagrams, runs, nb_runs);
+}
+
+void UdpTransport::sendRuns(const Datagram *datagrams, const std::array<std::pair<size_t, size_t>, SEND_BATCH_SIZE> &runs, size_t nb_runs)
+{
+  static const std::array<char, UDP_GSO_MAX_SEGMENT> padding{};
+  constexpr size_t control_size = CMSG_SPACE(sizeof(uint16_t));
+
+  std::array<mmsghdr, SEND_BATCH_SIZE> msgs;
+  std::array<iovec, 2 * SEND_BATCH_SIZE> iovs;            // a datagram and its padding
+  alignas(cmsghdr) std::array<std::array<char, control_size>, SEND_BATCH_SIZE> controls;
+  size_t nb_iovs = 0;
+
+  for (size_t r = 0; r < nb_runs; r++) {
+    const auto &[first, count] = runs[r];
+    size_t segment = 0;
+    for (size_t i = first; i < first + count; i++) segment = std::max(segment, datagrams[i].len);
+
+    // Every datagram but the last is padded to the segment size
+    iovec *run_iovs = &iovs[nb_iovs];
+    for (size_t i = first; i < first + count; i++) {
+      iovs[nb_iovs++] = iovec{const_cast<char*>(datagrams[i].data), datagrams[i].len};
+      if (i + 1 < first + count && datagrams[i].len < segment) {
+        iovs[nb_iovs++] = iovec{const_cast<char*>(padding.data()), segment - datagrams[i].len};
+      }
+    }
+
+    std::memset(&msgs[r], 0, sizeof(msgs[r]));
+    msghdr &hdr = msgs[r].msg_hdr;
+    hdr.msg_name = const_cast<sockaddr_in*>(&datagrams[first].dest);
+    hdr.msg_namelen = sizeof(datagrams[first].dest);
+    hdr.msg_iov = run_iovs;
+    hdr.msg_iovlen = static_cast<size_t>(&iovs[nb_iovs] - run_iovs);
+
+    if (count > 1) {
+      hdr.msg_control = controls[r].data();
+      hdr.msg_controllen = control_size;
+      cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+      cmsg->cmsg_level = IPPROTO_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t segment_size = static_cast<uint16_t>(segment);
+      std::memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+    }
+  }
+
+  std::array<int, SEND_BATCH_SIZE> errors;
+  sendMessages(msgs.data(), nb_runs, errors.data());
+
+  for (size_t r = 0; r < nb_runs; r++) {
+    const auto &[first, count] = runs[r];
+    if (errors[r] == 0) {
+      if (count == 1) continue;
+      segmented_sends.add();
+      segmented_datagrams.add(count);
+      continue;
+    }
+
+    // Socket shut down (node terminating): drop the datagrams
+    if (errors[r] == EPIPE) return;
+
+    // The device cannot segment (no checksum offload) or the kernel refuses the buffer: send plain datagrams from now on
+    if (count > 1 && (errors[r] == EIO || errors[r] == EINVAL || errors[r] == EOPNOTSUPP)) {
+      if (segmentation.exchange(false)) {
+        std::cout << "UDP segmentation offload failed (errno: " << strerror(errors[r]) << "), sending datagrams one by one\n";
+      }
+      send(&datagrams[first], count);
+      continue;
+    }
+
+    // Skip the datagrams that failed, they will be retransmitted
+    const sockaddr_in &dest = datagrams[first].dest;
+    std::ostringstream os;
+    os << "Failed to send packet (errno: " << strerror(errors[r]) << ") to " << dest.sin_addr.s_addr << ":" << dest.sin_port;
+    std::cout << os.str() << "\n";
+  }
+}
+
+void UdpTransport::sendMessages(mmsghdr *msgs, size_t count, int *errors)
+{
+  size_t sent = 0;
+  while (sent < count) {
+    int res = sendmmsg(sockets[0], &msgs[sent], static_cast<unsigned int>(count - sent), 0);
+    if (res < 0) {
+      // sendmmsg stops at the first failed message
+      errors[sent++] = errno;
+      continue;
+    }
+    for (size_t i = sent; i < sent + static_cast<size_t>(res); i++) errors[i] = 0;
+    sent += static_cast<size_t>(res);
+  }
+}
+
+ssize_t UdpTransport::receive(size_t queue, char *buffer, size_t size, sockaddr_in &sender)
+{
+  if (busy_poll) return spinReceive(queue, buffer, size, sender);
+  return receiveFrom(queue, buffer, size, sender, 0);
+}
+
+ssize_t UdpTransport::spinReceive(size_t queue, char *buffer, size_t size, sockaddr_in &sender)
+{
+  auto block_at = std::chrono::steady_clock::now() + std::chrono::microseconds(BUSY_POLL_SPIN_US);
+  while (true) {
+    // Returns 0 once shut down, as the blocking receive
+    ssize_t len = receiveFrom(queue, buffer, size, sender, MSG_DONTWAIT);
+    if (len >= 0 || errno != EAGAIN) return len; // EWOULDBLOCK is EAGAIN on Linux
+    if (std::chrono::steady_clock::now() >= block_at) break;
+    cpuRelax();
+  }
+  spin_blocks.add();
+  return receiveFrom(queue, buffer, size, sender, 0);
+}
+
+ssize_t UdpTransport::tryReceive(char *buffer, size_t size, sockaddr_in &sender)
+{
+  return receiveFrom(0, buffer, size, sender, MSG_DONTWAIT);
+}
+
+ssize_t UdpTransport::receiveFrom(size_t queue, char *buffer, size_t size, sockaddr_in &sender, int flags)
+{
+  size_t segment = 0;
+  if (!gro) return receiveMessage(queue, buffer, size, sender, flags, segment);
+
+  // Receive into the queue's buffer, then hand its segments out one by one
+  Coalesced &pending = coalesced[queue];
+  if (pending.offset >= pending.len) {
+    ssize_t len = receiveMessage(queue, pending.data.data(), pending.data.size(), pending.sender, flags, segment);
+    if (len <= 0) return len;
+
+    pending.offset = 0;
+    pending.len = static_cast<size_t>(len);
+    pending.segment = segment > 0 ? segment : pending.len;
+    if (pending.segment < pending.len) {
+      coalesced_receives.add();
+      coalesced_datagrams.add((pending.len + pending.segment - 1) / pending.segment);
+    }
+  }
+
+  size_t len = std::min(pending.segment, pending.len - pending.offset);
+  size_t copied = std::min(len, size);
+  std::memcpy(buffer, pending.data.data() + pending.offset, copied);
+  pending.offset += len;
+  sender = pending.sender;
+  return static_cast<ssize_t>(copied);
+}
+
+ssize_t UdpTransport::receiveMessage(size_t queue, char *buffer, size_t size, sockaddr_in &sender, int flags, size_t &segment)
+{
+  iovec iov{buffer, size};
+  alignas(cmsghdr) char control[receive_control_size];
+  msghdr msg{};
+  msg.msg_name = &sender;
+  msg.msg_namelen = sizeof(sender);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t len = recvmsg(sockets[queue], &msg, flags);
+  if (len < 0) return len;
+  readControl(queue, msg, segment);
+  return len;
+}
+
+void UdpTransport::readControl(size_t queue, msghdr &msg, size_t &segment)
+{
+  // Cumulative count of the socket (only sent once it is non-zero)
+  for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+      uint32_t dropped;
+      std::memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+      drops[queue].store(dropped, std::memory_order_relaxed);
+    }
+    // Segment size of a coalesced buffer
+    else if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+      int gso_size;
+      std::memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+      segment = static_cast<size_t>(gso_size);
+    }
+  }
+}
+
+uint64_t UdpTransport::receiveDrops() const
+{
+  uint64_t total = 0;
+  for (const auto &dropped: drops) total += dropped.load(std::memory_order_relaxed);
+  return total;
+}
+
+double UdpTransport::receiveQueueFill() const
+{
+  double fill = 0.0;
+  for (int socket_fd: sockets) {
+    std::array<uint32_t, SK_MEMINFO_VARS> meminfo{};
+    socklen_t len = sizeof(meminfo);
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_MEMINFO, meminfo.data(), &len) != 0 || meminfo[SK_MEMINFO_RCVBUF] == 0) continue;
+    fill = std::max(fill, static_cast<double>(meminfo[SK_MEMINFO_RMEM_ALLOC]) / meminfo[SK_MEMINFO_RCVBUF]);
+  }
+  return fill;
+}
+
+void UdpTransport::writeMetrics(std::ostream &os) const
+{
+  os << "transport.segmentation " << segmentation.load(std::memory_order_relaxed) << "\n"
+     << "transport.segmented_sends " << segmented_sends.load() << "\n"
+     << "transport.segmented_datagrams " << segmented_datagrams.load() << "\n"
+     << "transport.gro " << gro << "\n"
+     << "transport.coalesced_receives " << coalesced_receives.load() << "\n"
+     << "transport.coalesced_datagrams " << coalesced_datagrams.load() << "\n"
+     << "transport.busy_poll " << busy_poll << "\n"
+     << "transport.busy_poll_blocks " << spin_blocks.load() << "\n";
+}
+
+void UdpTransport::shutdown()
+{
+  // unblocks recvfrom if it's blocked
+  for (int socket_fd: sockets) ::shutdown(socket_fd, SHUT_RDWR);
+}
+
+void UdpTransport::close()
+{
+  for (int socket_fd: sockets) ::close(socket_fd);
+  sockets.clear();
+}
+// ===================== UdpTransport end ===================== //
+
+// ===================== InMemoryNetwork start ===================== //
+InMemoryNetwork::InMemoryNetwork(NetworkConditions conditions)
+  : conditions(conditions), rng(conditions.seed)
+{}
+
+std::unique_ptr<InMemoryTransport> InMemoryNetwork::attach(const sockaddr_in &addr)
+{
+  auto transport = std::make_unique<InMemoryTransport>(shared_from_this(), addr);
+  std::lock_guard<std::mutex> lock(mutex);
+  endpoints[ipAddressToString(addr)] = transport.get();
+  return transport;
+}
+
+void InMemoryNetwork::detach(const sockaddr_in &addr)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  endpoints.erase(ipAddressToString(addr));
+}
+
+void InMemoryNetwork::deliver(const sockaddr_in &from, const Datagram &datagram)
+{
+  // The destination is enqueued under the network lock, so it cannot detach meanwhile
+  std::lock_guard<std::mutex> lock(mutex);
+  auto endpoint = endpoints.find(ipAddressToString(datagram.dest));
+  if (endpoint == endpoints.end()) return;
+
+  if (conditions.loss > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < conditions.loss) return;
+
+  auto delay = conditions.delay;
+  if (conditions.jitter.count() > 0) {
+    delay += std::chrono::microseconds(std::uniform_int_distribution<int64_t>(0, conditions.jitter.count())(rng));
+  }
+
+  endpoint->second->enqueue({std::chrono::steady_clock::now() + delay, from,
+                             std::vector<char>(datagram.data, datagram.data + datagram.len)},
+                            conditions.inbox_capacity);
+}
+// ===================== InMemoryNetwork end ===================== //
+
+// ===================== InMemoryTransport start ===================== //
+InMemoryTransport::InMemoryTransport(std::shared_ptr<InMemoryNetwork> network, const sockaddr_in &addr)
+  : network(std::move(network)), addr(addr)
+{}
+
+InMemoryTransport::~InMemoryTransport()
+{
+  close();
+}
+
+void InMemoryTransport::send(const Datagram *datagrams, size_t count)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (shut_down) return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    network->deliver(addr, datagrams[i]);
+  }
+}
+
+ssize_t InMemoryTransport::receive(size_t, char *buffer, size_t size, sockaddr_in &sender)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    if (shut_down) return 0;
+
+    if (inbox.empty()) {
+      cv.wait(lock);
+      continue;
+    }
+
+    // Wait for the earliest datagram to arrive (an earlier one may be enqueued meanwhile)
+    auto earliest = inbox.begin();
+    auto deliver_at = earliest->first;
+    if (std::chrono::steady_clock::now() < deliver_at) {
+      cv.wait_until(lock, deliver_at);
+      continue;
+    }
+
+    const InFlight &datagram = earliest->second;
+    size_t len = std::min(size, datagram.data.size());
+    std::memcpy(buffer, datagram.data.data(), len);
+    sender = datagram.from;
+    inbox.erase(earliest);
+    return static_cast<ssize_t>(len);
+  }
+}
+
+void InMemoryTransport::shutdown()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    shut_down = true;
+  }
+  cv.notify_all();
+}
+
+void InMemoryTransport::close()
+{
+  shutdown();
+  network->detach(addr);
+}
+
+void InMemoryTransport::enqueue(InFlight &&datagram, size_t capacity)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (shut_down) return;
+    if (inbox.size() >= capacity) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    // Inserted after the datagrams due at the same time
+    auto deliver_at = datagram.deliver_at;
+    inbox.emplace(deliver_at, std::move(datagram));
+  }
+  cv.notify_one();
+}
+// ===================== InMemoryTransport end ===================== //
+
+// ===================== ShmTransport start ===================== //
+namespace {
+
+constexpr uint32_t wrap_marker = UINT32_MAX;   // record length telling the consumer to continue at the start of the ring
+
+/**
+ * Single-producer single-consumer byte ring in shared memory.
+ * Records are a 4 byte length followed by the datagram, padded to 8 bytes. Positions only grow.
+ */
+struct Ring {
+  alignas(64) std::atomic<uint64_t> head;      // consumer position
+  std::atomic<uint64_t> oversized;             // records dropped by the consumer as larger than its buffer
+  alignas(64) std::atomic<uint64_t> tail;      // producer position
+  alignas(64) char data[SHM_RING_BYTES];
+
+  static size_t recordSize(size_t len) { return (sizeof(uint32_t) + len + 7) & ~size_t{7}; }
+
+  size_t used() const { return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_relaxed); }
+
+  bool push(const char *datagram, size_t len)
+  {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t h = head.load(std::memory_order_acquire);
+    size_t need = recordSize(len);
+    size_t pos = t % SHM_RING_BYTES;
+    size_t contiguous = SHM_RING_BYTES - pos;
+
+    // Skip the end of the ring if the record does not fit before it
+    size_t skip = contiguous < need ? contiguous : 0;
+    if (t + skip + need - h > SHM_RING_BYTES) return false;
+    if (skip > 0) {
+      std::memcpy(data + pos, &wrap_marker, sizeof(wrap_marker));
+      pos = 0;
+    }
+
+    uint32_t len32 = static_cast<uint32_t>(len);
+    std::memcpy(data + pos, &len32, sizeof(len32));
+    std::memcpy(data + pos + sizeof(len32), datagram, len);
+    tail.store(t + skip + need, std::memory_order_release);
+    return true;
+  }
+
+  ssize_t pop(char *buffer, size_t size)
+  {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    while (h != tail.load(std::memory_order_acquire)) {
+      size_t pos = h % SHM_RING_BYTES;
+      uint32_t len;
+      std::memcpy(&len, data + pos, sizeof(len));
+      if (len == wrap_marker) {
+        h += SHM_RING_BYTES - pos;
+        head.store(h, std::memory_order_release);
+        continue;
+      }
+
+      // Dropped rather than truncated to a datagram the receiver would misread
+      if (len > size) {
+        oversized.fetch_add(1, std::memory_order_relaxed);
+        h += recordSize(len);
+        head.store(h, std::memory_order_release);
+        continue;
+      }
+
+      std::memcpy(buffer, data + pos + sizeof(len), len);
+      head.store(h + recordSize(len), std::memory_order_release);
+      return static_cast<ssize_t>(len);
+    }
+    return -1;
+  }
+};
+
+long futex(std::atomic<uint32_t> *word, int op, uint32_t value, const timespec *timeout)
+{
+  return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), op, value, timeout, nullptr, 0);
+}
+
+bool isLocal(in_addr_t ip, in_addr_t own_ip)
+{
+  return ip == own_ip || (ntohl(ip) >> 24) == 127;
+}
+
+} // namespace
+
+/**
+ * Region of a receiving process: doorbell followed by one ring per sending peer (indexed by peer index)
+ */
+struct ShmTransport::Region {
+  alignas(64) std::atomic<uint32_t> bell;      // futex word, bumped after every push
+  std::atomic<uint32_t> waiting;               // the receiver sleeps on the bell
+  std::atomic<uint32_t> closed;
+  std::atomic<uint32_t> dropped;               // datagrams dropped by the senders on a full ring
+
+  Ring *ring(size_t index)
+  {
+    return reinterpret_cast<Ring*>(reinterpret_cast<char*>(this) + sizeof(Region) + sizeof(Ring) * index);
+  }
+};
+
+ShmTransport::ShmTransport(const std::vector<Parser::Host> &hosts, unsigned long id, UdpConfig udp_config)
+  : udp(setupIpAddress(hosts[id - 1]), udp_config), self(id - 1),
+    region_size(sizeof(Region) + sizeof(Ring) * hosts.size())
+{
+  auto region_name = [](const Parser::Host &host) {
+    return "/da_proc_" + std::to_string(static_cast<unsigned>(host.portReadable()));
+  };
+
+  for (size_t i = 0; i < hosts.size(); i++) {
+    auto peer = std::make_unique<Peer>();
+    peer->local = isLocal(hosts[i].ip, hosts[self].ip);
+    peer->addr = setupIpAddress(hosts[i]);
+    peer->name = region_name(hosts[i]);
+    if (i != self) {
+      has_remote = has_remote || !peer->local;
+      peer_index[ipAddressToString(peer->addr)] = i;
+    }
+    peers.push_back(std::move(peer));
+  }
+
+  // Create the inbound region, replacing one left over by a previous run. A killed run leaves its region open:
+  // mark it closed first, so that peers which mapped it before the unlink move on to the new one.
+  name = region_name(hosts[self]);
+  int stale = shm_open(name.c_str(), O_RDWR, 0);
+  if (stale >= 0) {
+    struct stat st;
+    if (fstat(stale, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Region)) {
+      void *old = mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED, stale, 0);
+      if (old != MAP_FAILED) {
+        static_cast<Region*>(old)->closed.store(1);
+        munmap(old, sizeof(Region));
+      }
+    }
+    ::close(stale);
+  }
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 || ftruncate(fd, static_cast<off_t>(region_size)) != 0) {
+    if (fd >= 0) ::close(fd);
+    throw std::runtime_error("Failed to create shared memory region " + name + ": " + strerror(errno));
+  }
+  void *mapped = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    throw std::runtime_error("Failed to map shared memory region " + name + ": " + strerror(errno));
+  }
+  inbound = static_cast<Region*>(mapped);
+}
+
+ShmTransport::~ShmTransport()
+{
+  close();
+}
+
+ShmTransport::Region *ShmTransport::openPeer(Peer &peer)
+{
+  if (peer.region != nullptr) {
+    if (!peer.region->closed.load(std::memory_order_relaxed)) return peer.region;
+    // The peer has stopped
+    munmap(peer.region, region_size);
+    peer.region = nullptr;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  if (now < peer.next_attempt) return nullptr;
+  peer.next_attempt = now + std::chrono::milliseconds(SHM_OPEN_RETRY_MS);
+
+  // The region only becomes usable once its creator has sized it
+  int fd = shm_open(peer.name.c_str(), O_RDWR, 0);
+  if (fd < 0) return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != region_size) {
+    ::close(fd);
+    return nullptr;
+  }
+  void *mapped = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) return nullptr;
+
+  // Left over by a previous run, the peer has not replaced it yet
+  if (static_cast<Region*>(mapped)->closed.load()) {
+    munmap(mapped, region_size);
+    return nullptr;
+  }
+  peer.region = static_cast<Region*>(mapped);
+  return peer.region;
+}
+
+void ShmTransport::send(const Datagram *datagrams, size_t count)
+{
+  if (shut_down.load(std::memory_order_relaxed)) return;
+
+  std::vector<Datagram> over_udp;
+  for (size_t i = 0; i < count; i++) {
+    const Datagram &datagram = datagrams[i];
+    auto index = peer_index.find(ipAddressToString(datagram.dest));
+    if (index == peer_index.end() || !peers[index->second]->local) {
+      over_udp.push_back(datagram);
+      continue;
+    }
+
+    Peer &peer = *peers[index->second];
+    std::unique_lock<std::mutex> lock(peer.mutex);
+    Region *region = openPeer(peer);
+    if (region == nullptr) {
+      lock.unlock();
+      over_udp.push_back(datagram);
+      continue;
+    }
+
+    // Dropped if the ring is full
+    if (!region->ring(self)->push(datagram.data, datagram.len)) {
+      region->dropped.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    lock.unlock();
+
+    // Ring the doorbell (the receiver re-checks the rings if the bell moved before it slept)
+    region->bell.fetch_add(1);
+    if (region->waiting.load()) futex(&region->bell, FUTEX_WAKE, 1, nullptr);
+  }
+
+  if (!over_udp.empty()) udp.send(over_udp.data(), over_udp.size());
+}
+
+ssize_t ShmTransport::receive(size_t, char *buffer, size_t size, sockaddr_in &sender)
+{
+  // UDP is polled between sleeps: remote peers, and local peers that have not opened the region yet
+  timespec timeout{0, has_remote ? 1000000L : 50000000L};
+
+  while (!shut_down.load()) {
+    uint32_t bell = inbound->bell.load();
+
+    // Rings, round robin so that no peer starves the others
+    for (size_t k = 0; k < peers.size(); k++) {
+      size_t i = (next_ring + k) % peers.size();
+      if (i == self) continue;
+      ssize_t len = inbound->ring(i)->pop(buffer, size);
+      if (len >= 0) {
+        next_ring = i + 1;
+        sender = peers[i]->addr;
+        return len;
+      }
+    }
+
+    ssize_t len = udp.tryReceive(buffer, size, sender);
+    if (len >= 0) return len;
+
+    inbound->waiting.store(1);
+    futex(&inbound->bell, FUTEX_WAIT, bell, &timeout);
+    inbound->waiting.store(0);
+  }
+  return 0;
+}
+
+uint64_t ShmTransport::receiveDrops() const
+{
+  uint64_t dropped = udp.receiveDrops();
+  if (inbound == nullptr) return dropped;
+  dropped += inbound->dropped.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < peers.size(); i++) {
+    if (i != self) dropped += inbound->ring(i)->oversized.load(std::memory_order_relaxed);
+  }
+  return dropped;
+}
+
+void ShmTransport::writeMetrics(std::ostream &os) const
+{
+  udp.writeMetrics(os);
+}
+
+double ShmTransport::receiveQueueFill() const
+{
+  double fill = udp.receiveQueueFill();
+  if (inbound == nullptr) return fill;
+  for (size_t i = 0; i < peers.size(); i++) {
+    if (i == self) continue;
+    fill = std::max(fill, static_cast<double>(inbound->ring(i)->used()) / SHM_RING_BYTES);
+  }
+  return fill;
+}
+
+void ShmTransport::shutdown()
+{
+  shut_down.store(true);
+  udp.shutdown();
+  if (inbound != nullptr) {
+    inbound->bell.fetch_add(1);
+    futex(&inbound->bell, FUTEX_WAKE, INT32_MAX, nullptr);
+  }
+}
+
+void ShmTransport::close()
+{
+  if (inbound == nullptr) return;
+  shut_down.store(true);
+
+  inbound->closed.store(1);
+  munmap(inbound, region_size);
+  inbound = nullptr;
+  shm_unlink(name.c_str());
+
+  for (auto &peer: peers) {
+    std::lock_guard<std::mutex> lock(peer->mutex);
+    if (peer->region != nullptr) munmap(peer->region, region_size);
+    peer->region = nullptr;
+  }
+  udp.close();
+}
+// ===================== ShmTransport end ===================== //
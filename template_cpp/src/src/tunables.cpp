@@ -0,0 +1,105 @@
+#include "tunables.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+struct Parameter {
+  const char *name;
+  uint32_t Tunables::*field;
+  uint32_t min;
+  uint32_t max;
+};
+
+constexpr Parameter parameters[] = {
+  {"send_window", &Tunables::send_window, 1, MAX_SEND_WINDOW_SIZE},
+  {"messages_per_packet", &Tunables::messages_per_packet, 1, MAX_MESSAGES_PER_PACKET},
+  {"send_timeout_ms", &Tunables::send_timeout_ms, 0, 60000},
+  {"log_timeout_ms", &Tunables::log_timeout_ms, 1, 3600000},
+  {"broadcast_cooldown_ms", &Tunables::broadcast_cooldown_ms, 0, 60000},
+};
+
+std::string trim(const std::string &s)
+{
+  size_t begin = s.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) return "";
+  return s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
+}
+
+} // namespace
+
+void Tunables::set(const std::string &name, const std::string &value)
+{
+  for (const Parameter &parameter: parameters) {
+    if (name != parameter.name) continue;
+    unsigned long long parsed = 0;
+    size_t end = 0;
+    try {
+      parsed = std::stoull(value, &end);
+    } catch (const std::exception&) {
+      end = 0;
+    }
+    if (end == 0 || end != value.size() || value[0] == '-' || parsed < parameter.min || parsed > parameter.max) {
+      throw std::invalid_argument("Invalid value " + value + " for " + name + " (expected "
+                                  + std::to_string(parameter.min) + " to " + std::to_string(parameter.max) + ")");
+    }
+    this->*parameter.field = static_cast<uint32_t>(parsed);
+    return;
+  }
+  throw std::invalid_argument("Unknown tunable " + name);
+}
+
+uint32_t Tunables::get(const std::string &name) const
+{
+  for (const Parameter &parameter: parameters) {
+    if (name == parameter.name) return this->*parameter.field;
+  }
+  throw std::invalid_argument("Unknown tunable " + name);
+}
+
+void Tunables::assign(const std::string &assignment)
+{
+  size_t equal = assignment.find('=');
+  if (equal == std::string::npos) throw std::invalid_argument("Expected NAME=VALUE, got " + assignment);
+  set(trim(assignment.substr(0, equal)), trim(assignment.substr(equal + 1)));
+}
+
+void Tunables::load(const std::string &path)
+{
+  std::ifstream in(path);
+  if (!in) throw std::invalid_argument("Cannot read tuning file " + path);
+
+  std::string line;
+  size_t number = 0;
+  while (std::getline(in, line)) {
+    number++;
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty()) continue;
+    size_t separator = line.find_first_of("= \t");
+    if (separator == std::string::npos) {
+      throw std::invalid_argument(path + ":" + std::to_string(number) + ": expected NAME VALUE");
+    }
+    std::string value = trim(line.substr(separator));
+    if (!value.empty() && value[0] == '=') value = trim(value.substr(1));
+    try {
+      set(line.substr(0, separator), value);
+    } catch (const std::invalid_argument &e) {
+      throw std::invalid_argument(path + ":" + std::to_string(number) + ": " + e.what());
+    }
+  }
+}
+
+void Tunables::write(std::ostream &os) const
+{
+  for (const Parameter &parameter: parameters) {
+    os << parameter.name << " " << this->*parameter.field << "\n";
+  }
+}
+
+std::vector<std::string> Tunables::names()
+{
+  std::vector<std::string> result;
+  for (const Parameter &parameter: parameters) result.emplace_back(parameter.name);
+  return result;
+}
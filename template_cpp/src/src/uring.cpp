@@ -0,0 +1,331 @@
+#include "uring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ===================== IoUring start ===================== //
+namespace {
+
+void *mapRing(int ring_fd, size_t size, __u64 offset)
+{
+  void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, static_cast<off_t>(offset));
+  if (ptr == MAP_FAILED) throw std::runtime_error("Failed to map io_uring: " + std::string(strerror(errno)));
+  return ptr;
+}
+
+template <typename T>
+T *ringField(void *ring, __u32 offset)
+{
+  return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+} // namespace
+
+IoUring::IoUring(unsigned entries)
+{
+  params.flags = IORING_SETUP_CLAMP;
+  long fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (fd < 0) throw std::runtime_error("io_uring_setup failed: " + std::string(strerror(errno)));
+  ring_fd = static_cast<int>(fd);
+
+  try {
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+    sq_ring = mapRing(ring_fd, sq_ring_size, IORING_OFF_SQ_RING);
+    cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ring : mapRing(ring_fd, cq_ring_size, IORING_OFF_CQ_RING);
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(mapRing(ring_fd, sqes_size, IORING_OFF_SQES));
+  } catch (const std::runtime_error&) {
+    this->~IoUring();
+    throw;
+  }
+
+  sq_head = ringField<unsigned>(sq_ring, params.sq_off.head);
+  sq_tail = ringField<unsigned>(sq_ring, params.sq_off.tail);
+  sq_mask = ringField<unsigned>(sq_ring, params.sq_off.ring_mask);
+  sq_array = ringField<unsigned>(sq_ring, params.sq_off.array);
+  sqe_tail = *sq_tail;
+
+  cq_head = ringField<unsigned>(cq_ring, params.cq_off.head);
+  cq_tail = ringField<unsigned>(cq_ring, params.cq_off.tail);
+  cq_mask = ringField<unsigned>(cq_ring, params.cq_off.ring_mask);
+  cqes = ringField<io_uring_cqe>(cq_ring, params.cq_off.cqes);
+}
+
+IoUring::~IoUring()
+{
+  if (sqes != nullptr) munmap(sqes, sqes_size);
+  if (cq_ring != nullptr && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+  if (sq_ring != nullptr) munmap(sq_ring, sq_ring_size);
+  if (ring_fd >= 0) ::close(ring_fd);
+  sqes = nullptr;
+  cq_ring = sq_ring = nullptr;
+  ring_fd = -1;
+}
+
+io_uring_sqe *IoUring::getSqe()
+{
+  if (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= params.sq_entries) return nullptr;
+
+  io_uring_sqe *sqe = &sqes[sqe_tail & *sq_mask];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sq_array[sqe_tail & *sq_mask] = sqe_tail & *sq_mask;
+  sqe_tail++;
+  return sqe;
+}
+
+int IoUring::submitAndWait(unsigned wait_nr, const timespec *timeout)
+{
+  // Publish the new entries, and submit them with those a partial submission left in the queue
+  __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+  unsigned to_submit = sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+
+  unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+  io_uring_getevents_arg arg{};
+  void *argp = nullptr;
+  size_t argsz = 0;
+  if (timeout != nullptr) {
+    // The kernel reads the timeout as a __kernel_timespec (64 bit fields, as timespec on 64 bit targets)
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<__u64>(timeout);
+    flags |= IORING_ENTER_EXT_ARG;
+    argp = &arg;
+    argsz = sizeof(arg);
+  }
+
+  long res = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_nr, flags, argp, argsz);
+  return res < 0 ? -errno : static_cast<int>(res);
+}
+
+io_uring_cqe *IoUring::peekCqe()
+{
+  unsigned head = *cq_head;
+  if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) return nullptr;
+  return &cqes[head & *cq_mask];
+}
+
+void IoUring::cqeSeen()
+{
+  __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+}
+
+// ===================== IoUring end ===================== //
+
+// ===================== UringTransport start ===================== //
+UringTransport::UringTransport(const sockaddr_in &addr, UdpConfig config)
+  : UdpTransport(addr, config),
+    // Header, sender address, control messages, then the payload (up to a coalesced buffer)
+    buffer_size(sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in) + receive_control_size + UINT16_MAX)
+{
+  try {
+    send_ring = std::make_unique<IoUring>(2 * SEND_BATCH_SIZE);
+
+    for (size_t queue = 0; queue < sockets.size(); queue++) {
+      auto receiver = std::make_unique<Receiver>();
+      // Room for every buffer handed back, the receive and its rearm
+      receiver->ring = std::make_unique<IoUring>(URING_RECV_BUFFERS + 2);
+      receiver->buffers.resize(URING_RECV_BUFFERS * buffer_size);
+      for (uint16_t id = 0; id < URING_RECV_BUFFERS; id++) recycle(*receiver, id);
+
+      receiver->layout.msg_namelen = sizeof(sockaddr_in);
+      receiver->layout.msg_controllen = receive_control_size;
+      receivers.push_back(std::move(receiver));
+      arm(queue);
+
+      // Kernels without multishot recvmsg (< 6.0) or CQE skipping (< 5.17) reject the requests as they are
+      // submitted: their failure is already completed
+      io_uring_cqe *cqe = receivers[queue]->ring->peekCqe();
+      if (cqe != nullptr && cqe->res < 0 && cqe->res != -ENOBUFS) {
+        throw std::runtime_error(std::string("io_uring rejected the multishot receive: ") + strerror(-cqe->res));
+      }
+    }
+  } catch (const std::runtime_error&) {
+    close();
+    throw;
+  }
+}
+
+UringTransport::~UringTransport()
+{
+  close();
+}
+
+void UringTransport::arm(size_t queue)
+{
+  Receiver &receiver = *receivers[queue];
+  io_uring_sqe *sqe = receiver.ring->getSqe();
+  if (sqe == nullptr) return;
+
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = sockets[queue];
+  sqe->addr = reinterpret_cast<__u64>(&receiver.layout);
+  sqe->len = 1;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data = receive_tag;
+  receiver.ring->submitAndWait(0);
+  receiver.unsubmitted = 0;
+  receiver.armed = true;
+  rearms.add();
+}
+
+void UringTransport::recycle(Receiver &receiver, uint16_t id)
+{
+  io_uring_sqe *sqe = receiver.ring->getSqe();
+  if (sqe == nullptr) {
+    receiver.ring->submitAndWait(0);
+    receiver.unsubmitted = 0;
+    sqe = receiver.ring->getSqe();
+  }
+
+  // Successful hand-backs post no completion
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = 1;                            // number of buffers
+  sqe->addr = reinterpret_cast<__u64>(receiver.buffers.data() + id * buffer_size);
+  sqe->len = static_cast<__u32>(buffer_size);
+  sqe->off = id;
+  sqe->buf_group = 0;
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = provide_tag;
+
+  // Batched, so that a busy listener returning from peeked completions does not starve the receive
+  if (++receiver.unsubmitted >= URING_RECV_BUFFERS / 4) {
+    receiver.ring->submitAndWait(0);
+    receiver.unsubmitted = 0;
+  }
+}
+
+ssize_t UringTransport::receiveMessage(size_t queue, char *buffer, size_t size, sockaddr_in &sender, int flags, size_t &segment)
+{
+  Receiver &receiver = *receivers[queue];
+  timespec wait{0, static_cast<long>(URING_WAIT_MS) * 1000000L};
+
+  while (!shut_down.load(std::memory_order_relaxed)) {
+    if (!receiver.armed) arm(queue);
+
+    io_uring_cqe *cqe = receiver.ring->peekCqe();
+    if (cqe == nullptr) {
+      if (flags & MSG_DONTWAIT) {
+        errno = EAGAIN;
+        return -1;
+      }
+      // Bounded wait, so that a shutdown is noticed
+      receiver.ring->submitAndWait(1, &wait);
+      receiver.unsubmitted = 0;
+      continue;
+    }
+
+    int res = cqe->res;
+    unsigned cqe_flags = cqe->flags;
+    bool provided = cqe->user_data == provide_tag;
+    receiver.ring->cqeSeen();
+    if (provided) {
+      std::cout << "io_uring failed to provide a receive buffer (errno: " << strerror(-res) << ")\n";
+      continue;
+    }
+    if (!(cqe_flags & IORING_CQE_F_MORE)) receiver.armed = false;
+
+    if (res < 0) {
+      // Out of buffers: the receive is rearmed on the next iteration
+      if (res == -ENOBUFS) continue;
+      errno = -res;
+      return -1;
+    }
+    if (!(cqe_flags & IORING_CQE_F_BUFFER)) continue;
+
+    // The buffer starts with the recvmsg header, then the name and control areas sized as in the layout
+    uint16_t id = static_cast<uint16_t>(cqe_flags >> IORING_CQE_BUFFER_SHIFT);
+    char *data = receiver.buffers.data() + id * buffer_size;
+    io_uring_recvmsg_out out;
+    std::memcpy(&out, data, sizeof(out));
+    char *name = data + sizeof(out);
+    char *control = name + receiver.layout.msg_namelen;
+    char *payload = control + receiver.layout.msg_controllen;
+
+    std::memcpy(&sender, name, std::min<size_t>(out.namelen, sizeof(sender)));
+    msghdr msg{};
+    msg.msg_control = control;
+    msg.msg_controllen = out.controllen;
+    readControl(queue, msg, segment);
+
+    size_t copied = std::min<size_t>(out.payloadlen, size);
+    std::memcpy(buffer, payload, copied);
+    recycle(receiver, id);
+    return static_cast<ssize_t>(copied);
+  }
+  return 0;
+}
+
+void UringTransport::sendMessages(mmsghdr *msgs, size_t count, int *errors)
+{
+  std::lock_guard<std::mutex> lock(send_mutex);
+  if (send_ring_broken || count > 2 * SEND_BATCH_SIZE) {
+    UdpTransport::sendMessages(msgs, count, errors);
+    return;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    io_uring_sqe *sqe = send_ring->getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = sockets[0];
+    sqe->addr = reinterpret_cast<__u64>(&msgs[i].msg_hdr);
+    sqe->len = 1;
+    sqe->user_data = i;
+  }
+
+  // One system call submits the messages and waits for them (UDP sends complete inline). After a partial
+  // submission the kernel returns without waiting, and the next call submits the rest.
+  size_t completed = 0;
+  unsigned wait_nr = static_cast<unsigned>(count);
+  while (completed < count) {
+    int res = send_ring->submitAndWait(wait_nr);
+    send_submissions.add();
+    if (res < 0 && res != -EINTR && res != -EAGAIN && res != -EBUSY) {
+      // The submitted entries may reference these messages: never enter the ring again
+      std::cout << "io_uring send failed (errno: " << strerror(-res) << "), sending with sendmmsg\n";
+      send_ring_broken = true;
+      for (size_t i = 0; i < count; i++) errors[i] = -res;
+      return;
+    }
+
+    for (io_uring_cqe *cqe = send_ring->peekCqe(); cqe != nullptr; cqe = send_ring->peekCqe()) {
+      errors[cqe->user_data] = cqe->res < 0 ? -cqe->res : 0;
+      send_ring->cqeSeen();
+      completed++;
+    }
+    wait_nr = static_cast<unsigned>(count - completed);
+  }
+}
+
+void UringTransport::writeMetrics(std::ostream &os) const
+{
+  UdpTransport::writeMetrics(os);
+  os << "transport.uring_send_submissions " << send_submissions.load() << "\n"
+     << "transport.uring_receive_arms " << rearms.load() << "\n";
+}
+
+void UringTransport::shutdown()
+{
+  shut_down.store(true);
+  UdpTransport::shutdown();
+}
+
+void UringTransport::close()
+{
+  // The rings go first: they reference the sockets and the buffers
+  receivers.clear();
+  send_ring.reset();
+  UdpTransport::close();
+}
+// ===================== UringTransport end ===================== //
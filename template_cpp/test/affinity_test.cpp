@@ -0,0 +1,76 @@
+#include "affinity.hpp"
+
+#include <iostream>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// If parameter is not true, test fails
+// This check function would be provided by the test framework
+static int test_failed = 0;
+#define IS_TRUE(x) do { if (!(x)) {std::cout << __FUNCTION__ << " failed on line " << __LINE__ << std::endl; test_failed = 1; } } while (0)
+
+static bool rejects(const std::string &assignment) {
+  CpuAffinity affinity;
+  try {
+    affinity.assign(assignment);
+  } catch (const std::invalid_argument&) {
+    return affinity.empty();
+  }
+  return false;
+}
+
+static void testLists() {
+  CpuAffinity affinity;
+  IS_TRUE(affinity.empty());
+
+  affinity.assign("listener=2,3");
+  affinity.assign("worker=4-7");
+  affinity.assign("sender=0,8-9,1");
+  affinity.assign("logger=5-5");
+  IS_TRUE(!affinity.empty());
+  IS_TRUE(affinity.cpuList(CpuAffinity::Role::LISTENER) == std::vector<int>({2, 3}));
+  IS_TRUE(affinity.cpuList(CpuAffinity::Role::WORKER) == std::vector<int>({4, 5, 6, 7}));
+  IS_TRUE(affinity.cpuList(CpuAffinity::Role::SENDER) == std::vector<int>({0, 8, 9, 1}));
+  IS_TRUE(affinity.cpuList(CpuAffinity::Role::LOGGER) == std::vector<int>({5}));
+  IS_TRUE(affinity.cpuList(CpuAffinity::Role::PROPOSER).empty());
+
+  // A later assignment replaces the list of its role
+  affinity.assign("listener=1");
+  IS_TRUE(affinity.cpuList(CpuAffinity::Role::LISTENER) == std::vector<int>({1}));
+}
+
+static void testRejects() {
+  IS_TRUE(rejects("listener"));                // no list
+  IS_TRUE(rejects("receiver=1"));              // unknown role
+  IS_TRUE(rejects("listener="));
+  IS_TRUE(rejects("listener=1,"));
+  IS_TRUE(rejects("listener=,1"));
+  IS_TRUE(rejects("listener=a"));
+  IS_TRUE(rejects("listener=1x"));
+  IS_TRUE(rejects("listener=-1"));
+  IS_TRUE(rejects("listener=3-1"));            // decreasing range
+  IS_TRUE(rejects("listener=1-"));
+  IS_TRUE(rejects("listener=" + std::to_string(CPU_SETSIZE)));
+}
+
+static void testPin() {
+  // The CPU the test runs on is always allowed; roles without CPUs are left alone
+  int cpu = sched_getcpu();
+  CpuAffinity affinity;
+  affinity.assign("worker=" + std::to_string(cpu));
+
+  std::thread thread([]() noexcept {});
+  IS_TRUE(affinity.pin(thread, CpuAffinity::Role::WORKER, 3));
+  IS_TRUE(affinity.pin(thread, CpuAffinity::Role::SENDER, 0));
+  thread.join();
+}
+
+int main() {
+  testLists();
+  testRejects();
+  testPin();
+  return test_failed ? 1 : 0;
+}
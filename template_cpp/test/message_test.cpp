@@ -25,9 +25,13 @@ static void testPacketSerialization() {
   Packet msg(MES, nb_mes, seqs, msgs);
   msg.displayPacket();  
 
-  const char* serialized = msg.serialize();
-  Packet::displaySerialized(serialized);
-  Packet deserialized_pkt = Packet::deserialize(serialized);
+  std::vector<char> buffer(Packet::max_serialized_size);
+  size_t len = msg.serialize(buffer.data());
+  IS_TRUE(len == msg.serializedSize());
+
+  const char* serialized = buffer.data();
+  Packet::displaySerialized(serialized, len);
+  Packet deserialized_pkt = Packet::deserialize(serialized, len);
 
   deserialized_pkt.displayPacket();  
 
@@ -42,7 +46,82 @@ static void testPacketSerialization() {
   }
 }
 
+static void testMessageWireImage() {
+  Message msg(MessageType::NACK, 42, 3, std::set<proposal_t>({ 7, 8, 9, 100000 }));
+
+  // The wire image is encoded once and reused
+  const std::vector<char>& wire = msg.wireImage();
+  IS_TRUE(wire.size() == msg.serializedSize());
+  IS_TRUE(&wire == &msg.wireImage());
+
+  size_t offset = 0;
+  Message decoded = Message::deserialize(wire.data(), wire.size(), offset);
+  IS_TRUE(offset == wire.size());
+  IS_TRUE(decoded == msg);
+
+  // A copy edited after the original was encoded gets its own image
+  Message copy = msg;
+  copy.round = 4;
+  copy.proposed_values.push_back(100001);
+  offset = 0;
+  decoded = Message::deserialize(copy.wireImage().data(), copy.wireImage().size(), offset);
+  IS_TRUE(decoded == copy);
+
+  Message assigned(MessageType::ACK, 1, 1, std::vector<proposal_t>{});
+  assigned.wireImage();
+  assigned = copy;
+  offset = 0;
+  decoded = Message::deserialize(assigned.wireImage().data(), assigned.wireImage().size(), offset);
+  IS_TRUE(decoded == copy);
+  IS_TRUE(&msg.wireImage() == &wire);
+}
+
+static bool rejects(const std::vector<char>& datagram, size_t len) {
+  try {
+    Packet::deserialize(datagram.data(), len);
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+static void testMalformedPackets() {
+  std::array<pkt_seq_t, MAX_MESSAGES_PER_PACKET> seqs{ 1, 2 };
+  std::array<std::shared_ptr<const Message>, MAX_MESSAGES_PER_PACKET> msgs = {
+    std::make_shared<Message>(MessageType::MES, 10, 5, std::set<proposal_t>({ 1, 2, 3 })),
+    std::make_shared<Message>(MessageType::NACK, 11, 6, std::set<proposal_t>({ 2 }))
+  };
+  Packet pkt(MES, 2, seqs, msgs);
+  std::vector<char> datagram(Packet::max_serialized_size);
+  size_t len = pkt.serialize(datagram.data());
+
+  // Every truncation is rejected, bytes past the packet (segmentation padding) are ignored
+  for (size_t size = 0; size < len; size++) {
+    IS_TRUE(rejects(datagram, size));
+  }
+  IS_TRUE(!rejects(datagram, len));
+  IS_TRUE(!rejects(datagram, datagram.size()));
+
+  // Unknown packet and message types, too many messages
+  std::vector<char> corrupt = datagram;
+  corrupt[0] = 7;
+  IS_TRUE(rejects(corrupt, len));
+  corrupt = datagram;
+  corrupt[2 + sizeof(pkt_seq_t)] = 3;
+  IS_TRUE(rejects(corrupt, len));
+  corrupt = datagram;
+  corrupt[1] = static_cast<char>(MAX_MESSAGES_PER_PACKET + 1);
+  IS_TRUE(rejects(corrupt, corrupt.size()));
+
+  Packet ack = pkt.toAck();
+  len = ack.serialize(datagram.data());
+  IS_TRUE(rejects(datagram, len - 1));
+  IS_TRUE(Packet::deserialize(datagram.data(), len).getSeqs() == seqs);
+}
+
 int main() {
   testPacketSerialization();
+  testMessageWireImage();
+  testMalformedPackets();
   return test_failed ? 1 : 0;
 }
\ No newline at end of file
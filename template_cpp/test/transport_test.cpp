@@ -0,0 +1,191 @@
+#include "transport.hpp"
+#include "helper.hpp"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <signal.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// If parameter is not true, test fails
+// This check function would be provided by the test framework
+static int test_failed = 0;
+#define IS_TRUE(x) do { if (!(x)) {std::cout << __FUNCTION__ << " failed on line " << __LINE__ << std::endl; test_failed = 1; } } while (0)
+
+static sockaddr_in loopback(unsigned short port) {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  return addr;
+}
+
+// Every sender must land on the queue steeringQueue computes, whatever the order the sockets were bound in
+static void testSteeringPartition() {
+  constexpr size_t nb_queues = 4;
+  constexpr size_t nb_senders = 16;
+  UdpConfig config;
+  config.sockets = nb_queues;
+  config.steer_by_source = true;
+  sockaddr_in addr = loopback(static_cast<unsigned short>(20000 + getpid() % 20000));
+  UdpTransport transport(addr, config);
+  IS_TRUE(transport.receiveQueues() == nb_queues);
+
+  std::mutex mutex;
+  std::map<std::string, std::vector<size_t>> received;   // sender -> queues it was received on
+  std::vector<std::thread> listeners;
+  for (size_t queue = 0; queue < nb_queues; queue++) {
+    listeners.emplace_back([&, queue]() {
+      char buffer[64];
+      sockaddr_in sender;
+      while (transport.receive(queue, buffer, sizeof(buffer), sender) > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        received[ipAddressToString(sender)].push_back(queue);
+      }
+    });
+  }
+
+  std::vector<int> senders;
+  std::map<std::string, sockaddr_in> sender_addrs;
+  for (size_t i = 0; i < nb_senders; i++) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in source = loopback(0);
+    bind(fd, reinterpret_cast<const sockaddr*>(&source), sizeof(source));
+    socklen_t len = sizeof(source);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&source), &len);
+    sender_addrs[ipAddressToString(source)] = source;
+    for (int k = 0; k < 4; k++) {
+      char byte = static_cast<char>(k);
+      sendto(fd, &byte, sizeof(byte), 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    }
+    senders.push_back(fd);
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  transport.shutdown();
+  for (auto &listener: listeners) listener.join();
+  for (int fd: senders) close(fd);
+
+  IS_TRUE(received.size() == nb_senders);
+  for (const auto &[sender, queues]: received) {
+    IS_TRUE(queues.size() == 4);
+    for (size_t queue: queues) {
+      IS_TRUE(queue == UdpTransport::steeringQueue(sender_addrs[sender], nb_queues));
+    }
+  }
+}
+
+// Two local processes on loopback, on ports free for this test run
+static std::vector<Parser::Host> localHosts(unsigned short base) {
+  std::string ip = "127.0.0.1";
+  return { Parser::Host(1, ip, base), Parser::Host(2, ip, static_cast<unsigned short>(base + 1)) };
+}
+
+// Datagram of len bytes starting with its number
+static std::vector<char> numbered(uint32_t number, size_t len) {
+  std::vector<char> data(len, static_cast<char>(number));
+  std::memcpy(data.data(), &number, sizeof(number));
+  return data;
+}
+
+static void sendTo(ShmTransport &transport, const sockaddr_in &dest, const std::vector<char> &data) {
+  Datagram datagram{data.data(), data.size(), dest};
+  transport.send(&datagram, 1);
+}
+
+// Receives the next datagram and checks it is numbered datagram of len bytes
+static bool receiveNumbered(ShmTransport &transport, uint32_t number, size_t len) {
+  std::vector<char> buffer(2 * len);
+  sockaddr_in sender;
+  ssize_t received = transport.receive(0, buffer.data(), buffer.size(), sender);
+  if (received != static_cast<ssize_t>(len)) return false;
+  buffer.resize(len);
+  return buffer == numbered(number, len);
+}
+
+// The ring keeps datagrams in order across its end, and drops them once full
+static void testShmRing() {
+  auto hosts = localHosts(static_cast<unsigned short>(40000 + getpid() % 20000));
+  ShmTransport sender(hosts, 1);
+  ShmTransport receiver(hosts, 2);
+  sockaddr_in dest = setupIpAddress(hosts[1]);
+
+  // 1000 byte datagrams take 1008 bytes of the ring: 260 fit, the end of the ring is skipped
+  constexpr size_t len = 1000;
+  constexpr uint32_t capacity = SHM_RING_BYTES / 1008;
+  for (uint32_t i = 0; i < capacity + 100; i++) sendTo(sender, dest, numbered(i, len));
+  IS_TRUE(receiver.receiveDrops() == 100);
+  IS_TRUE(receiver.receiveQueueFill() > 0.99);
+  for (uint32_t i = 0; i < capacity; i++) IS_TRUE(receiveNumbered(receiver, i, len));
+  IS_TRUE(receiver.receiveQueueFill() < 0.01);
+
+  // Around the ring a few more times, with the consumer half a ring behind
+  uint32_t next_received = capacity;
+  for (uint32_t i = capacity; i < 4 * capacity; i++) {
+    sendTo(sender, dest, numbered(i, len));
+    if (i >= capacity + capacity / 2) IS_TRUE(receiveNumbered(receiver, next_received++, len));
+  }
+  while (next_received < 4 * capacity) IS_TRUE(receiveNumbered(receiver, next_received++, len));
+  IS_TRUE(receiver.receiveDrops() == 100);
+
+  // A datagram larger than the receive buffer is dropped, not truncated
+  sendTo(sender, dest, numbered(1, 3 * len));
+  sendTo(sender, dest, numbered(2, len));
+  IS_TRUE(receiveNumbered(receiver, 2, len));
+  IS_TRUE(receiver.receiveDrops() == 101);
+}
+
+// A process restarting after being killed replaces its region, and its peers move over to the new one
+static void testShmStaleRegion() {
+  auto hosts = localHosts(static_cast<unsigned short>(40000 + (getpid() + 2) % 20000));
+  sockaddr_in dest = setupIpAddress(hosts[1]);
+  ShmTransport sender(hosts, 1);
+
+  int ready[2];
+  IS_TRUE(pipe(ready) == 0);
+  pid_t child = fork();
+  if (child == 0) {
+    ShmTransport killed(hosts, 2);
+    char byte = 1;
+    if (write(ready[1], &byte, 1) != 1) _exit(1);
+    pause();
+    _exit(0);
+  }
+  char byte;
+  IS_TRUE(read(ready[0], &byte, 1) == 1);
+  ::close(ready[0]);
+  ::close(ready[1]);
+
+  // The sender maps the region of the first run, which is then killed without closing it
+  sendTo(sender, dest, numbered(1, 100));
+  kill(child, SIGKILL);
+  waitpid(child, nullptr, 0);
+
+  ShmTransport restarted(hosts, 2);
+  std::this_thread::sleep_for(std::chrono::milliseconds(SHM_OPEN_RETRY_MS + 50));
+  sendTo(sender, dest, numbered(2, 100));
+
+  // Unblocks the receive if the datagram went to the stale ring
+  std::atomic_bool received{false};
+  std::thread watchdog([&]() {
+    for (int i = 0; i < 50 && !received.load(); i++) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (!received.load()) restarted.shutdown();
+  });
+  IS_TRUE(receiveNumbered(restarted, 2, 100));
+  received.store(true);
+  watchdog.join();
+}
+
+int main() {
+  testSteeringPartition();
+  testShmRing();
+  testShmStaleRegion();
+  return test_failed ? 1 : 0;
+}
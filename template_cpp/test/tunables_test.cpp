@@ -0,0 +1,122 @@
+#include "tunables.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+// If parameter is not true, test fails
+// This check function would be provided by the test framework
+static int test_failed = 0;
+#define IS_TRUE(x) do { if (!(x)) {std::cout << __FUNCTION__ << " failed on line " << __LINE__ << std::endl; test_failed = 1; } } while (0)
+
+// True if f throws std::invalid_argument
+template <typename F>
+static bool rejects(F f) {
+  try {
+    f();
+  } catch (const std::invalid_argument&) {
+    return true;
+  }
+  return false;
+}
+
+// Overwrites the scratch tuning file of the test and returns its path
+static std::string writeFile(const std::string &content) {
+  std::string path = "/tmp/tunables_test." + std::to_string(getpid());
+  std::ofstream(path) << content;
+  return path;
+}
+
+static void testDefaults() {
+  Tunables tunables;
+  IS_TRUE(tunables.send_window == SEND_WINDOW_SIZE);
+  IS_TRUE(tunables.messages_per_packet == MESSAGES_PER_PACKET);
+  IS_TRUE(tunables.log_timeout_ms == LOG_TIMEOUT);
+  for (const std::string &name: Tunables::names()) IS_TRUE(!rejects([&]() { tunables.get(name); }));
+}
+
+static void testAssign() {
+  Tunables tunables;
+  tunables.assign("send_window=64");
+  tunables.assign(" messages_per_packet = 4 ");
+  tunables.set("broadcast_cooldown_ms", "0");
+  IS_TRUE(tunables.send_window == 64);
+  IS_TRUE(tunables.get("messages_per_packet") == 4);
+  IS_TRUE(tunables.broadcast_cooldown_ms == 0);
+
+  // Bounds are inclusive
+  tunables.set("messages_per_packet", std::to_string(MAX_MESSAGES_PER_PACKET));
+  IS_TRUE(tunables.messages_per_packet == MAX_MESSAGES_PER_PACKET);
+  tunables.set("send_window", "1");
+  IS_TRUE(tunables.send_window == 1);
+}
+
+static void testRejects() {
+  Tunables tunables;
+  IS_TRUE(rejects([&]() { tunables.assign("send_window"); }));                 // no value
+  IS_TRUE(rejects([&]() { tunables.assign("window=8"); }));                    // unknown name
+  IS_TRUE(rejects([&]() { tunables.set("send_window", "0"); }));               // below the range
+  IS_TRUE(rejects([&]() { tunables.set("messages_per_packet", std::to_string(MAX_MESSAGES_PER_PACKET + 1)); }));
+  IS_TRUE(rejects([&]() { tunables.set("send_window", "-1"); }));
+  IS_TRUE(rejects([&]() { tunables.set("send_window", "8x"); }));
+  IS_TRUE(rejects([&]() { tunables.set("send_window", ""); }));
+  IS_TRUE(rejects([&]() { tunables.set("send_window", "99999999999999999999"); }));
+  IS_TRUE(rejects([&]() { tunables.get("window"); }));
+
+  // Failed assignments leave the value unchanged
+  IS_TRUE(tunables.send_window == SEND_WINDOW_SIZE);
+}
+
+static void testLoad() {
+  std::string path = writeFile("# tuned for a lossy network\n"
+                               "\n"
+                               "send_window 16\n"
+                               "messages_per_packet=12   # inline comment\n"
+                               "  send_timeout_ms = 3\n");
+  Tunables tunables;
+  tunables.load(path);
+  IS_TRUE(tunables.send_window == 16);
+  IS_TRUE(tunables.messages_per_packet == 12);
+  IS_TRUE(tunables.send_timeout_ms == 3);
+  IS_TRUE(tunables.log_timeout_ms == LOG_TIMEOUT);   // not in the file
+
+  // What write produces loads back to the same values
+  std::ostringstream written;
+  tunables.write(written);
+  std::string copy_path = writeFile(written.str());
+  Tunables copy;
+  copy.load(copy_path);
+  for (const std::string &name: Tunables::names()) IS_TRUE(copy.get(name) == tunables.get(name));
+  std::remove(copy_path.c_str());
+}
+
+static void testLoadRejects() {
+  Tunables tunables;
+  IS_TRUE(rejects([&]() { tunables.load("/nonexistent/tuning"); }));
+  IS_TRUE(rejects([&]() { tunables.load(writeFile("send_window\n")); }));        // no value
+  IS_TRUE(rejects([&]() { tunables.load(writeFile("send_window 0\n")); }));      // out of range
+  IS_TRUE(rejects([&]() { tunables.load(writeFile("unknown 3\n")); }));
+
+  // The error names the file and line
+  std::string path = writeFile("send_window 8\nmessages_per_packet 99\n");
+  try {
+    tunables.load(path);
+    IS_TRUE(false);
+  } catch (const std::invalid_argument &e) {
+    IS_TRUE(std::string(e.what()).find(path + ":2:") == 0);
+  }
+  std::remove(path.c_str());
+}
+
+int main() {
+  testDefaults();
+  testAssign();
+  testRejects();
+  testLoad();
+  testLoadRejects();
+  return test_failed ? 1 : 0;
+}